@@ -0,0 +1,190 @@
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace.h"
+
+using namespace std;
+
+// Memory dependence profile of a trace, without simulating it: for every load, the
+// distance back to the last store to the same address, as a power-of-two histogram,
+// how many loads alias a store fewer than a ROB's worth of micro-ops older (so both
+// could be in flight together), and which store PCs each load PC reads from (the
+// store sets an oracle would build).
+//     ./depprofile art-100M.trace.gz
+// The profile is written next to the trace as <trace>.deps and printed. Later runs
+// print that file instead of reading the trace again, as long as the trace has not
+// changed. -w sets the distance below which a producer store is recorded (default 1024).
+
+const int BUCKETS = 40;
+const uint64_t WINDOWS[] = { 32, 64, 128, 256, 512, 1024 };
+const int NUM_WINDOWS = sizeof(WINDOWS) / sizeof(WINDOWS[0]);
+
+struct StoreRef
+{
+    uint64_t age;
+    uint64_t pc;
+};
+
+struct LoadProfile
+{
+    uint64_t count;
+    uint64_t aliased;
+    map<uint64_t, uint64_t> producers;    // store PC -> loads it fed within the window
+};
+
+// Bucket b holds distances in [2^b, 2^(b+1)).
+int bucket(uint64_t distance)
+{
+    int b = 0;
+    while(distance >>= 1)
+        b++;
+    return b;
+}
+
+// The first line of the sidecar identifies the trace it was built from.
+string header(const struct stat &st, uint64_t window)
+{
+    char line[128];
+    snprintf(line, sizeof(line), "# depprofile size %" PRIu64 " mtime %" PRIu64 " window %" PRIu64 "\n",
+             uint64_t(st.st_size), uint64_t(st.st_mtime), window);
+    return line;
+}
+
+bool printCached(const char *name, const string &expected)
+{
+    FILE *file = fopen(name, "r");
+    if(file == NULL)
+        return false;
+    char line[128];
+    if(fgets(line, sizeof(line), file) == NULL || expected != line)
+    {
+        fclose(file);
+        return false;
+    }
+
+    fputs(line, stdout);
+    char data[1 << 16];
+    size_t n;
+    while((n = fread(data, 1, sizeof(data), file)) > 0)
+        fwrite(data, 1, n, stdout);
+    fclose(file);
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t window = 1024;
+    int arg = 1;
+    if(arg + 1 < argc && strcmp(argv[arg], "-w") == 0)
+    {
+        window = strtoull(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+    if(arg >= argc || window == 0)
+    {
+        fprintf(stderr, "Usage: %s [-w uops] <trace file>\n", argv[0]);
+        return 1;
+    }
+    const char *traceName = argv[arg];
+    string profileName = string(traceName) + ".deps";
+
+    FILE *inputFile = fopen(traceName, "rb");
+    struct stat st;
+    if(inputFile == NULL || fstat(fileno(inputFile), &st) != 0)
+    {
+        fprintf(stderr, "Error opening trace %s\n", traceName);
+        return 1;
+    }
+    string first = header(st, window);
+    if(printCached(profileName.c_str(), first))
+        return 0;
+
+    TraceReader trace;
+    trace.open(inputFile);
+
+    unordered_map<uint64_t, StoreRef> lastStore;
+    map<uint64_t, LoadProfile> loads;
+    vector<uint64_t> histogram(BUCKETS, 0);
+    vector<uint64_t> within(NUM_WINDOWS, 0);
+    uint64_t totalMicroops = 0, totalLoads = 0, totalStores = 0, noProducer = 0;
+
+    TraceRecord r;
+    while(trace.next(r))
+    {
+        uint64_t age = ++totalMicroops;
+        if(r.loadStore == 'S')
+        {
+            StoreRef &s = lastStore[r.addressForMemoryOp];
+            s.age = age;
+            s.pc = r.instructionAddress;
+            totalStores++;
+        }
+        else if(r.loadStore == 'L')
+        {
+            totalLoads++;
+            LoadProfile &load = loads[r.instructionAddress];
+            load.count++;
+            unordered_map<uint64_t, StoreRef>::iterator itr = lastStore.find(r.addressForMemoryOp);
+            if(itr == lastStore.end())
+            {
+                noProducer++;
+                continue;
+            }
+            uint64_t distance = age - itr->second.age;
+            histogram[min(bucket(distance), BUCKETS - 1)]++;
+            for(int i = NUM_WINDOWS - 1; i >= 0 && distance < WINDOWS[i]; i--)
+                within[i]++;
+            if(distance < window)
+            {
+                load.aliased++;
+                load.producers[itr->second.pc]++;
+            }
+        }
+    }
+
+    FILE *file = fopen((profileName + ".tmp").c_str(), "w");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Error opening %s.tmp\n", profileName.c_str());
+        return 1;
+    }
+    fputs(first.c_str(), file);
+    fprintf(file, "microops %" PRIu64 " loads %" PRIu64 " stores %" PRIu64 " load-pcs %zu\n",
+            totalMicroops, totalLoads, totalStores, loads.size());
+    fprintf(file, "no-producer %" PRIu64 "\n", noProducer);
+
+    // loads whose last store to the address is fewer than w micro-ops older, and their share
+    for(int i = 0; i < NUM_WINDOWS; i++)
+        fprintf(file, "aliased-within %" PRIu64 " %" PRIu64 " %f\n", WINDOWS[i], within[i], totalLoads ? double(within[i]) / totalLoads : 0);
+    for(int b = 0; b < BUCKETS; b++)
+        if(histogram[b])
+            fprintf(file, "distance %" PRIu64 "-%" PRIu64 " %" PRIu64 "\n", uint64_t(1) << b, (uint64_t(2) << b) - 1, histogram[b]);
+
+    // load PC, executions, executions aliasing within the window, then store PC:count
+    for(map<uint64_t, LoadProfile>::iterator itr = loads.begin(); itr != loads.end(); itr++)
+    {
+        if(itr->second.aliased == 0)
+            continue;
+        fprintf(file, "load %" PRIx64 " %" PRIu64 " %" PRIu64, itr->first, itr->second.count, itr->second.aliased);
+        map<uint64_t, uint64_t> &producers = itr->second.producers;
+        for(map<uint64_t, uint64_t>::iterator p = producers.begin(); p != producers.end(); p++)
+            fprintf(file, " %" PRIx64 ":%" PRIu64, p->first, p->second);
+        fprintf(file, "\n");
+    }
+    fclose(file);
+    rename((profileName + ".tmp").c_str(), profileName.c_str());
+
+    if(!printCached(profileName.c_str(), first))
+    {
+        fprintf(stderr, "Error reading %s\n", profileName.c_str());
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,2344 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <cassert>
+#include <cinttypes>
+#include <cstdbool>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <set>
+#include <vector>
+#include <string>
+#include <map>
+#include <queue>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+#include <thread>
+#include <type_traits>
+
+#include "trace.h"
+
+using namespace std;
+
+const uint64_t INF = 0x7FFFFFFFFFFFFFFF;
+const int nPhysicalReg = 2048;
+const int N = 8;
+bool debug = false;
+
+// sst table sizes (rounded up to powers of two) and whether the SSIT index folds the
+// upper PC bits into the lower ones instead of just taking the low bits.
+int ssitEntries = 4096;
+int lfstEntries = 128;
+bool ssitFolded = false;
+
+// Capacity of each ss2/ss3/ss4 store set table (rounded up to a power of two), and
+// whether ss4 merges the load's and store's sets on a violation instead of moving the
+// store into the load's set.
+int storeSetEntries = 1 << 16;
+bool ss4Merge = false;
+
+// Latency of a load whose data an executed older store forwards; 0 leaves every load
+// at the cache latency and turns the forwarding model off.
+int forwardLatency = 0;
+const int MAX_FORWARD_LATENCY = 1024;
+
+// Recover from a memory order violation by re-executing only the load and the micro-ops
+// that depend on it through registers, instead of squashing everything after it.
+bool selectiveRecovery = false;
+
+// Cycle at which each physical register's value is ready: INF from rename until its
+// producer issues, then the issue cycle plus the producer's latency.
+struct ScoreBoard
+{
+    vector<uint64_t> readyCycle;
+
+    ScoreBoard()
+    {
+        readyCycle.resize(nPhysicalReg, 0);
+    }
+
+    bool isReady(int reg, uint64_t cycle)
+    {
+        if(reg == -1)
+            return true;
+        return readyCycle[reg] <= cycle;
+    }
+
+    uint64_t& operator[](int ind)
+    {
+        return readyCycle[ind];
+    }
+
+    void reset()
+    {
+        for(uint32_t i = 0; i < readyCycle.size(); i++)
+            readyCycle[i] = 0;
+    }
+
+};
+
+// The rename map as it was before a load renamed, with the free list's head then.
+struct RenameCheckpoint
+{
+    int mapping[50];
+    uint64_t freeHead;
+};
+
+// The free list is a ring: rename allocates at freeHead and commit frees at freeTail.
+// Squashed micro-ops allocated the registers just behind freeHead, so squashing back
+// to a load only has to restore its checkpoint.
+struct MapTable
+{
+    int mapping[50];
+    vector<int16_t> freeList;
+    uint64_t freeHead, freeTail;
+
+    void reset()
+    {
+        for(int i = 0; i < 50; i++)
+            mapping[i] = i;
+        freeList.assign(nPhysicalReg, -1);
+        freeHead = freeTail = 0;
+        for(int i = 50; i < nPhysicalReg; i++)
+            release(i);
+    }
+
+    int allocate()
+    {
+        if(freeHead == freeTail)
+        {
+            fprintf(stderr, "Error: out of physical registers, the ROB is too large\n");
+            abort();
+        }
+        return freeList[freeHead++ % nPhysicalReg];
+    }
+
+    void release(int reg)
+    {
+        freeList[freeTail++ % nPhysicalReg] = reg;
+    }
+
+    void save(RenameCheckpoint &c)
+    {
+        memcpy(c.mapping, mapping, sizeof(mapping));
+        c.freeHead = freeHead;
+    }
+
+    void restore(const RenameCheckpoint &c)
+    {
+        memcpy(mapping, c.mapping, sizeof(mapping));
+        freeHead = c.freeHead;
+    }
+};
+
+// Everything about a micro-op that is fixed by its static instruction, decoded once
+// per (PC, micro-op index) and shared by every dynamic instance of it.
+struct StaticMicroOp
+{
+    uint32_t id;
+    uint64_t instructionAddress;
+    int32_t microOpCount;
+    int32_t sourceRegister1;
+    int32_t sourceRegister2;
+    int32_t destinationRegister;
+    char conditionRegister;
+    char loadStore;
+    int64_t immediate;
+    uint64_t fallthroughPC;
+    char macroOperation[12];
+    char microOperation[23];
+
+    int32_t archSrc1;
+    int32_t archSrc2;
+    int32_t archSrc3;
+    int32_t archDest1;
+    int32_t archDest2;
+    bool isLoad, isStore;
+    int latency;
+
+    void init(const TraceRecord &r)
+    {
+       instructionAddress = r.instructionAddress;
+       microOpCount = r.microOpCount;
+       sourceRegister1 = r.sourceRegister1;
+       sourceRegister2 = r.sourceRegister2;
+       destinationRegister = r.destinationRegister;
+       conditionRegister = r.conditionRegister;
+       loadStore = r.loadStore;
+       immediate = r.immediate;
+       fallthroughPC = r.fallthroughPC;
+       memcpy(macroOperation, r.macroOperation, r.macroLength);
+       macroOperation[r.macroLength] = '\0';
+       memcpy(microOperation, r.microOperation, r.microLength);
+       microOperation[r.microLength] = '\0';
+
+       archSrc1 = sourceRegister1;
+       archSrc2 = sourceRegister2;
+       archSrc3 = conditionRegister == 'R' ? 49 : -1;
+
+       archDest1 = destinationRegister;
+       archDest2 = conditionRegister == 'W' ? 49 : -1;
+
+       isLoad = loadStore == 'L';
+       isStore = loadStore == 'S';
+       latency = 1;
+       if(isLoad) latency +=2;
+    }
+
+    bool matches(const TraceRecord &r) const
+    {
+        return sourceRegister1 == r.sourceRegister1 && sourceRegister2 == r.sourceRegister2 &&
+            destinationRegister == r.destinationRegister && conditionRegister == r.conditionRegister &&
+            loadStore == r.loadStore && immediate == r.immediate && fallthroughPC == r.fallthroughPC &&
+            strlen(macroOperation) == r.macroLength && memcmp(macroOperation, r.macroOperation, r.macroLength) == 0 &&
+            strlen(microOperation) == r.microLength && memcmp(microOperation, r.microOperation, r.microLength) == 0;
+    }
+};
+
+// Static micro-ops by (PC, micro-op index). Entries are never freed or moved, so a
+// MicroOp can hold a plain pointer. If the trace ever shows a different instruction
+// at a known key, that key is simply pointed at a new entry.
+struct StaticTable
+{
+    deque<StaticMicroOp> entries;
+    unordered_map<uint64_t, StaticMicroOp*> index;
+
+    const StaticMicroOp* lookup(const TraceRecord &r)
+    {
+        StaticMicroOp *&slot = index[(r.instructionAddress << 8) ^ uint32_t(r.microOpCount)];
+        if(slot && slot->instructionAddress == r.instructionAddress && slot->microOpCount == r.microOpCount && slot->matches(r))
+            return slot;
+
+        entries.push_back(StaticMicroOp());
+        slot = &entries.back();
+        slot->init(r);
+        slot->id = entries.size() - 1;
+        return slot;
+    }
+
+    void serialize(Snapshot &s)
+    {
+        s.io(entries);
+        if(!s.reading)
+            return;
+        index.clear();
+        for(size_t i = 0; i < entries.size(); i++)
+            index[(entries[i].instructionAddress << 8) ^ uint32_t(entries[i].microOpCount)] = &entries[i];
+    }
+};
+
+// A dynamic micro-op: a handle to its static instruction plus what changes per instance.
+struct MicroOp
+{
+    const StaticMicroOp *inst;
+    uint64_t addressForMemoryOp;
+    uint64_t age;
+    uint64_t fetchCycle;
+    uint64_t issueCycle;
+    uint64_t doneCycle;
+    uint64_t commitCycle;
+
+    int16_t physicalSrc1;
+    int16_t physicalSrc2;
+    int16_t physicalSrc3;
+    int16_t physicalDest1;
+    int16_t physicalDest2;
+    int16_t physicalRegToFree1;
+    int16_t physicalRegToFree2;
+
+    bool isLoad, isStore;
+    bool issued;
+    bool forwarded;           // its data came from an older store still in the ROB
+    int latency;
+    uint8_t pending;          // source registers whose producer has not issued
+    uint32_t generation;      // squash count at rename, to spot stale issue queue events
+    int32_t ssid;             // sst: store set read from the SSIT at rename, -1 if none
+    uint64_t storeDependence; // sst: age of the store it must issue after, INF if none
+
+    void init(const StaticMicroOp *inst, uint64_t addressForMemoryOp, uint64_t age)
+    {
+       this->inst = inst;
+       this->addressForMemoryOp = addressForMemoryOp;
+       this->age = age;
+       isLoad = inst->isLoad;
+       isStore = inst->isStore;
+       reset();
+    }
+
+    void reset()
+    {
+		physicalSrc1 = -1;
+		physicalSrc2 = -1;
+		physicalSrc3 = -1;
+		physicalDest1 = -1;
+		physicalDest2 = -1;
+		physicalRegToFree1 = -1;
+		physicalRegToFree2 = -1;
+		fetchCycle = issueCycle = doneCycle = commitCycle = INF;
+		issued = false;
+		ssid = -1;
+		storeDependence = INF;
+		latency = inst->latency;
+		forwarded = false;
+    }
+
+    void serialize(Snapshot &s, StaticTable &table)
+    {
+        uint32_t id = s.reading ? 0 : inst->id;
+        s.io(id);
+        inst = &table.entries[id];
+        s.io(addressForMemoryOp);
+        s.io(age);
+        s.io(fetchCycle);
+        s.io(issueCycle);
+        s.io(doneCycle);
+        s.io(commitCycle);
+        s.io(physicalSrc1);
+        s.io(physicalSrc2);
+        s.io(physicalSrc3);
+        s.io(physicalDest1);
+        s.io(physicalDest2);
+        s.io(physicalRegToFree1);
+        s.io(physicalRegToFree2);
+        s.io(isLoad);
+        s.io(isStore);
+        s.io(issued);
+        s.io(forwarded);
+        s.io(latency);
+        s.io(ssid);
+        s.io(storeDependence);
+    }
+};
+
+const uint8_t ROB_LOAD = 1, ROB_STORE = 2, ROB_ISSUED = 4;
+
+// Circular ROB. Ages in it are always consecutive (squashed micro-ops are refetched
+// with the same ages), so an entry lives in slot age & mask, and a squashed micro-op
+// waits in its slot, past the end of the ROB, to be refetched. The fields the issue
+// logic scans are kept in their own arrays; ops holds the whole micro-op, and its
+// issued/issueCycle/doneCycle are kept in step by markIssued().
+struct ROB
+{
+    uint32_t maxMicroOps;
+    uint64_t mask;
+    uint64_t headAge;
+    uint32_t count;
+
+    vector<uint8_t> flags;
+    vector<uint64_t> pc;
+    vector<uint64_t> address;
+    vector<uint64_t> issueCycle;
+    vector<uint64_t> doneCycle;
+    vector<MicroOp> ops;
+
+    ROB()
+    {
+       reset(1);
+    }
+
+    void reset(int n)
+    {
+        maxMicroOps = n;
+        size_t capacity = 1;
+        while(capacity < maxMicroOps)
+            capacity <<= 1;
+        mask = capacity - 1;
+        headAge = 0;
+        count = 0;
+        flags.assign(capacity, 0);
+        pc.assign(capacity, 0);
+        address.assign(capacity, 0);
+        issueCycle.assign(capacity, INF);
+        doneCycle.assign(capacity, INF);
+        ops.resize(capacity);
+    }
+
+    bool empty()
+    {
+        return count == 0;
+    }
+
+    bool full()
+    {
+        return count == maxMicroOps;
+    }
+
+    // one past the youngest entry
+    uint64_t endAge()
+    {
+        return headAge + count;
+    }
+
+    bool contains(uint64_t age)
+    {
+        return age >= headAge && age - headAge < count;
+    }
+
+    MicroOp& operator[](uint64_t age)
+    {
+        return ops[age & mask];
+    }
+
+    MicroOp& front()
+    {
+        return ops[headAge & mask];
+    }
+
+    MicroOp& back()
+    {
+        return ops[(headAge + count - 1) & mask];
+    }
+
+    void push_back(const MicroOp &m)
+    {
+        ops[m.age & mask] = m;
+        append(m.age);
+    }
+
+    // Adds the micro-op already in the slot for age, the next one unless the ROB is empty.
+    void append(uint64_t age)
+    {
+        if(count == 0)
+            headAge = age;
+        size_t i = age & mask;
+        MicroOp &m = ops[i];
+        flags[i] = (m.isLoad ? ROB_LOAD : 0) | (m.isStore ? ROB_STORE : 0) | (m.issued ? ROB_ISSUED : 0);
+        pc[i] = m.inst->instructionAddress;
+        address[i] = m.addressForMemoryOp;
+        issueCycle[i] = m.issueCycle;
+        doneCycle[i] = m.doneCycle;
+        count++;
+    }
+
+    void pop_front()
+    {
+        headAge++;
+        count--;
+    }
+
+    void pop_back()
+    {
+        count--;
+    }
+
+    void markIssued(MicroOp &m, uint64_t cycle)
+    {
+        size_t i = m.age & mask;
+        m.issued = true;
+        m.issueCycle = cycle;
+        m.doneCycle = cycle + m.latency;
+        flags[i] |= ROB_ISSUED;
+        issueCycle[i] = m.issueCycle;
+        doneCycle[i] = m.doneCycle;
+    }
+
+    void markUnissued(MicroOp &m)
+    {
+        size_t i = m.age & mask;
+        m.issued = false;
+        m.issueCycle = m.doneCycle = INF;
+        flags[i] &= ~ROB_ISSUED;
+        issueCycle[i] = doneCycle[i] = INF;
+    }
+};
+
+// Micro-ops decoded once and shared by every configuration simulated in the same run.
+// ops[0] has age firstAge; the window ends just before endAge, and the trace ends
+// there too if last is set. Each refill keeps the previous window's last N micro-ops,
+// since a simulator stops short of the end of a window with fewer than N left.
+const int WINDOW_SIZE = 1 << 12;
+
+struct TraceWindow
+{
+    StaticTable staticTable;
+    vector<MicroOp> ops;
+    uint64_t firstAge;
+    uint64_t endAge;
+    bool last;
+
+    TraceWindow()
+    {
+        ops.resize(N + WINDOW_SIZE);
+        firstAge = endAge = 1;
+        last = false;
+    }
+
+    void refill(TraceReader &trace)
+    {
+        size_t keep = min<uint64_t>(N, endAge - firstAge);
+        copy(ops.begin() + (endAge - firstAge - keep), ops.begin() + (endAge - firstAge), ops.begin());
+        firstAge = endAge - keep;
+
+        TraceRecord r;
+        size_t n = keep;
+        while(n < ops.size() && trace.next(r))
+        {
+            ops[n].init(staticTable.lookup(r), r.addressForMemoryOp, firstAge + n);
+            n++;
+        }
+        endAge = firstAge + n;
+        last = n < ops.size();
+    }
+
+    void serialize(Snapshot &s)
+    {
+        staticTable.serialize(s);
+        s.io(firstAge);
+        s.io(endAge);
+        s.io(last);
+        for(uint64_t i = 0; i < endAge - firstAge; i++)
+            ops[i].serialize(s, staticTable);
+    }
+};
+
+// An interval simulated in detail: micro-ops with ages in [start, end), its share of
+// the whole trace, and what the detailed run measured for it. Detailed simulation
+// starts at warmup (<= start) so the pipeline and predictor are warm by start.
+// fetchCycles runs from fetching start to fetching end, cycles on to the ROB draining.
+struct SamplePoint
+{
+    uint64_t start, end;
+    double weight;
+    uint64_t cycles;
+    uint64_t microops;
+    uint64_t warmup;
+    uint64_t fetchCycles;
+};
+
+bool compareSamples(const SamplePoint &a, const SamplePoint &b)
+{
+    return a.start < b.start;
+}
+
+// A micro-op in the ROB as the issue queue refers to it. A squash bumps the simulator's
+// generation, so events for squashed micro-ops (whose ages are refetched) are ignored.
+struct IssueEvent
+{
+    uint64_t age;
+    uint32_t generation;
+};
+
+// Longest latency of a micro-op from the trace (a load), as StaticMicroOp sets them.
+const int MAX_STATIC_LATENCY = 3;
+
+// Event-driven wakeup and select. Micro-ops waiting on an unissued producer sit on
+// that register's consumer list; when the producer issues they are scheduled on the
+// wheel for the cycle their last source becomes ready, and from then on they are in
+// ready, ordered by age. Stores are put on completing for the cycle they finish, when
+// younger loads are checked for a memory order violation.
+struct IssueQueue
+{
+    set<uint64_t> ready;
+    vector<vector<IssueEvent> > wakeups;     // by cycle & wheelMask
+    vector<vector<IssueEvent> > completing;
+    vector<vector<IssueEvent> > consumers;
+    uint64_t wheelMask;
+
+    // The wheel is longer than any latency, so an event is never scheduled a full turn ahead.
+    void reset(int maxLatency)
+    {
+        ready.clear();
+        size_t size = 1;
+        while(size <= size_t(maxLatency))
+            size <<= 1;
+        wakeups.assign(size, vector<IssueEvent>());
+        completing.assign(size, vector<IssueEvent>());
+        wheelMask = size - 1;
+        consumers.assign(nPhysicalReg, vector<IssueEvent>());
+    }
+};
+
+// Issued loads still in the ROB, by address, so a finishing store finds the loads that
+// may have read memory before it without scanning the younger half of the ROB.
+struct LoadQueue
+{
+    unordered_map<uint64_t, vector<uint64_t> > issued;
+
+    void insert(uint64_t address, uint64_t age)
+    {
+        issued[address].push_back(age);
+    }
+
+    void erase(uint64_t address, uint64_t age)
+    {
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = issued.find(address);
+        vector<uint64_t> &ages = itr->second;
+        for(size_t i = 0; i < ages.size(); i++)
+            if(ages[i] == age)
+            {
+                ages[i] = ages.back();
+                ages.pop_back();
+                break;
+            }
+        if(ages.empty())
+            issued.erase(itr);
+    }
+};
+
+// Stores in the ROB by address, oldest first, so perfect disambiguation finds the older
+// stores to a load's address without scanning the ROB. Stores enter at rename and leave
+// at commit (always the oldest for their address) or squash (always the youngest).
+struct StoreQueue
+{
+    unordered_map<uint64_t, vector<uint64_t> > inFlight;
+
+    void push(uint64_t address, uint64_t age)
+    {
+        inFlight[address].push_back(age);
+    }
+
+    void popOldest(uint64_t address)
+    {
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = inFlight.find(address);
+        if(itr->second.size() == 1)
+            inFlight.erase(itr);
+        else
+            itr->second.erase(itr->second.begin());
+    }
+
+    void popYoungest(uint64_t address)
+    {
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = inFlight.find(address);
+        itr->second.pop_back();
+        if(itr->second.empty())
+            inFlight.erase(itr);
+    }
+};
+
+size_t roundUp(size_t n)
+{
+    size_t size = 1;
+    while(size < n)
+        size <<= 1;
+    return size;
+}
+
+inline uint64_t flatHash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    return key ^ (key >> 33);
+}
+
+inline uint64_t flatHash(const pair<uint64_t, uint64_t> &key)
+{
+    return flatHash(key.first * 0x9e3779b97f4a7c15ULL ^ key.second);
+}
+
+const int FLAT_PROBES = 8;
+const uint32_t NO_OWNER = 0xFFFFFFFF;
+
+// Fixed-capacity open-addressed hash table for the store sets. A key lives in one of the
+// FLAT_PROBES slots from its home slot, and an entry counts only while it carries the
+// table's generation, so clear() is a single increment. When all of a key's slots are
+// taken, the entry in its home slot is replaced.
+template<class K, class V> struct FlatTable
+{
+    struct Entry
+    {
+        K key;
+        V value;
+        uint32_t generation;  // 0 is never current
+    };
+
+    vector<Entry> entries;
+    uint32_t generation;
+    K lastEvicted;
+
+    void reset(size_t capacity)
+    {
+        entries.assign(roundUp(capacity), Entry());
+        generation = 1;
+    }
+
+    void clear()
+    {
+        generation++;
+    }
+
+    // The slot holding key, or entries.size() if it is missing. A slot stays the key's
+    // until it is erased, replaced or cleared, so it can serve as a dense ID.
+    size_t findSlot(const K &key)
+    {
+        size_t home = flatHash(key);
+        for(int i = 0; i < FLAT_PROBES; i++)
+        {
+            size_t slot = (home + i) & (entries.size() - 1);
+            if(entries[slot].generation == generation && entries[slot].key == key)
+                return slot;
+        }
+        return entries.size();
+    }
+
+    // The slot for key, added with V() if it is missing (then added is set). If a live
+    // entry had to be replaced, evicted is set and points at its key until the next insert.
+    size_t insertSlot(const K &key, bool *added = NULL, const K **evicted = NULL)
+    {
+        if(added)
+            *added = false;
+        if(evicted)
+            *evicted = NULL;
+        size_t home = flatHash(key), free = entries.size();
+        for(int i = 0; i < FLAT_PROBES; i++)
+        {
+            size_t slot = (home + i) & (entries.size() - 1);
+            Entry &e = entries[slot];
+            if(e.generation != generation)
+            {
+                if(free == entries.size())
+                    free = slot;
+            }
+            else if(e.key == key)
+                return slot;
+        }
+
+        if(free == entries.size())
+        {
+            free = home & (entries.size() - 1);
+            lastEvicted = entries[free].key;
+            if(evicted)
+                *evicted = &lastEvicted;
+        }
+        if(added)
+            *added = true;
+        Entry &e = entries[free];
+        e.key = key;
+        e.value = V();
+        e.generation = generation;
+        return free;
+    }
+
+    V* find(const K &key)
+    {
+        size_t slot = findSlot(key);
+        return slot == entries.size() ? NULL : &entries[slot].value;
+    }
+
+    V& insert(const K &key, const K **evicted = NULL)
+    {
+        return entries[insertSlot(key, NULL, evicted)].value;
+    }
+
+    void erase(const K &key)
+    {
+        size_t home = flatHash(key);
+        for(int i = 0; i < FLAT_PROBES; i++)
+        {
+            Entry &e = entries[(home + i) & (entries.size() - 1)];
+            if(e.generation == generation && e.key == key)
+                e.generation = 0;
+        }
+    }
+
+    void serialize(Snapshot &s)
+    {
+        s.io(entries);
+        s.io(generation);
+    }
+};
+
+// Most recent store per (hashed) address, seen while fast-forwarding.
+struct RecentStore
+{
+    uint64_t address;
+    uint64_t pc;
+    uint64_t age;
+};
+
+const int RECENT_STORES = 1 << 16;
+
+struct Simulator;
+
+// A memory dependence predictor. The pipeline asks it whether a load (or store) whose
+// registers are ready must still wait for an older store, trains it on violations and
+// tells it when memory micro-ops rename, issue, are squashed and commit. Simulator::run
+// is compiled once per predictor class, so on the simulated path these calls go to the
+// class's own versions of the hooks below, which hide the defaults, and inline; only the
+// cold virtual functions are called through the base. To add a predictor, derive a final
+// class, define the hooks it needs and list it in predictorTypes. A hook must have exactly
+// the signature below, or it would not replace the default; createPredictor checks that.
+struct Predictor
+{
+    virtual ~Predictor() {}
+
+    // Whether loads may issue before older stores, so violations have to be caught.
+    virtual bool speculates() { return true; }
+    // Whether the pipeline has to keep the in-flight stores by address for it.
+    virtual bool needsStoreQueue() { return false; }
+    // Called every million micro-ops, so stale dependences do not pile up.
+    virtual void clear() {}
+    virtual void serialize(Snapshot &) {}
+
+    bool mustWait(Simulator &, MicroOp &) { return false; }
+    void renamed(Simulator &, MicroOp &) {}
+    void storeIssued(Simulator &, MicroOp &) {}
+    void squashed(Simulator &, MicroOp &) {}
+    void committed(Simulator &, MicroOp &) {}
+    // The load at loadPC read memory before the older store at storePC wrote it.
+    void violation(uint64_t /*loadPC*/, uint64_t /*storePC*/) {}
+};
+
+typedef bool WaitHook(Simulator &, MicroOp &);
+typedef void NotifyHook(Simulator &, MicroOp &);
+typedef void TrainHook(uint64_t, uint64_t);
+
+// Whether hook, as T has it, is the base version or one with the same signature.
+template<class T, class Hook, class P> constexpr bool matchesHook(P)
+{
+    return is_same<P, Hook T::*>::value || is_same<P, Hook Predictor::*>::value;
+}
+
+// A predictor by name: how to create it, and the pipeline compiled for it.
+struct PredictorType
+{
+    const char *name;
+    Predictor* (*create)();
+    void (Simulator::*run)(const TraceWindow &window);
+};
+
+const PredictorType* findPredictor(const string &name);
+
+// One pipeline configuration: its own ROB, scoreboard, map table and predictor.
+// The functions on the simulated path are templates on the predictor class (see simulate()).
+struct Simulator
+{
+    const PredictorType *type;
+    Predictor *predictor;
+    FILE *outputFile;
+    ScoreBoard scoreBoard;
+    ROB rob;
+    MapTable mapTable;
+    vector<RenameCheckpoint> checkpoints;  // by ROB slot, taken as each load renames
+    uint64_t replayEnd;       // squashed ages from rob.endAge() up to this are refetched first
+    IssueQueue issueQueue;
+    uint32_t generation;
+    LoadQueue loadQueue;      // only kept when speculating
+    StoreQueue storeQueue;    // only kept for predictors that need it, or to model forwarding
+    bool keepStores;
+    int forwardLatency;
+    uint64_t forwardedLoads;  // committed (in sampled runs, timed) loads that were forwarded
+    bool selectiveRecovery;
+
+    uint64_t currentCycle;
+    uint64_t totalMicroops;
+    uint64_t skipped;         // micro-ops before --start
+    bool done;
+
+    // With SimPoint samples only the chosen intervals are timed; everything between
+    // them is fast-forwarded functionally. fetchLimit is the age fetch stops at.
+    vector<SamplePoint> samples;
+    uint64_t sampleIndex;
+    bool fastForwarding;
+    uint64_t regionStart;
+    uint64_t regionStartCycle;
+    uint64_t fetchLimit;
+    vector<RecentStore> recentStores;
+
+    Simulator() : type(NULL), predictor(NULL) {}
+
+    ~Simulator()
+    {
+        delete predictor;
+    }
+
+    void setPredictor(const PredictorType *type)
+    {
+        this->type = type;
+        delete predictor;
+        predictor = type->create();
+        keepStores = predictor->needsStoreQueue() || forwardLatency > 0;
+    }
+
+    void reset(const PredictorType *type, int size, FILE *outputFile)
+    {
+        this->outputFile = outputFile;
+        scoreBoard.reset();
+        mapTable.reset();
+        rob.reset(size);
+        checkpoints.assign(rob.mask + 1, RenameCheckpoint());
+        replayEnd = 0;
+        generation = 0;
+        loadQueue.issued.clear();
+        storeQueue.inFlight.clear();
+        this->forwardLatency = ::forwardLatency;
+        issueQueue.reset(max(MAX_STATIC_LATENCY, forwardLatency));
+        this->selectiveRecovery = ::selectiveRecovery;
+        forwardedLoads = 0;
+        setPredictor(type);
+        currentCycle = 0;
+        totalMicroops = 0;
+        skipped = 0;
+        done = false;
+        samples.clear();
+        sampleIndex = 0;
+        fastForwarding = false;
+        regionStart = INF;
+        regionStartCycle = 0;
+        fetchLimit = INF;
+    }
+
+    void setSamples(const vector<SamplePoint> &points, uint64_t warmup)
+    {
+        samples = points;
+        for(size_t i = 0; i < samples.size(); i++)
+            samples[i].warmup = samples[i].start > warmup ? samples[i].start - warmup : 1;
+        sampleIndex = 0;
+        fastForwarding = !samples.empty();
+        recentStores.assign(RECENT_STORES, RecentStore());
+    }
+
+    // Changes the forwarding latency of a restored run from here on.
+    void setForwardLatency(int latency)
+    {
+        forwardLatency = latency;
+        keepStores = predictor->needsStoreQueue() || forwardLatency > 0;
+        rebuildIssueQueue();
+    }
+
+    // Whether a micro-op whose registers are ready may issue as far as memory ordering goes.
+    template<class T> bool memoryReady(MicroOp &m)
+    {
+        return !(m.isLoad || m.isStore) || !static_cast<T*>(predictor)->mustWait(*this, m);
+    }
+
+    // Whether the youngest older store to the load's address has executed, so it
+    // forwards its data instead of the load reading the cache.
+    bool forwards(MicroOp &load)
+    {
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = storeQueue.inFlight.find(load.addressForMemoryOp);
+        if(itr == storeQueue.inFlight.end())
+            return false;
+        vector<uint64_t> &ages = itr->second;
+        for(size_t j = ages.size(); j-- > 0; )
+            if(ages[j] < load.age)
+            {
+                size_t i = ages[j] & rob.mask;
+                return (rob.flags[i] & ROB_ISSUED) && rob.doneCycle[i] <= currentCycle;
+            }
+        return false;
+    }
+
+    template<class T> void recoverMOV(uint64_t loadAge)
+    {
+        T &p = *static_cast<T*>(predictor);
+        mapTable.restore(checkpoints[loadAge & rob.mask]);
+        if(!replaying())
+            replayEnd = rob.endAge();
+        generation++;
+        issueQueue.ready.erase(issueQueue.ready.lower_bound(loadAge), issueQueue.ready.end());
+        while(!rob.empty())
+        {
+            MicroOp &m = rob.back();
+            if(m.age < loadAge)
+                break;
+
+            rob.pop_back();
+            if(m.isLoad && m.issued && p.speculates())
+                loadQueue.erase(m.addressForMemoryOp, m.age);
+            if(m.isLoad || m.isStore)
+                p.squashed(*this, m);
+            if(m.isStore && keepStores)
+                storeQueue.popYoungest(m.addressForMemoryOp);
+        }
+    }
+
+    // Selective recovery: the load and every younger micro-op reading a register it
+    // (transitively) writes go back to waiting for their sources, with new generations
+    // so their old issue queue events are ignored. Independent micro-ops keep their results.
+    template<class T> void replayDependents(uint64_t loadAge)
+    {
+        T &p = *static_cast<T*>(predictor);
+        vector<bool> replayed(nPhysicalReg, false);
+        for(uint64_t age = loadAge; age < rob.endAge(); age++)
+        {
+            MicroOp &m = rob[age];
+            if(age != loadAge && !(m.physicalSrc1 != -1 && replayed[m.physicalSrc1]) &&
+               !(m.physicalSrc2 != -1 && replayed[m.physicalSrc2]) && !(m.physicalSrc3 != -1 && replayed[m.physicalSrc3]))
+                continue;
+
+            if(m.issued)
+            {
+                if(m.isLoad && p.speculates())
+                    loadQueue.erase(m.addressForMemoryOp, m.age);
+                rob.markUnissued(m);
+            }
+            m.forwarded = false;
+            m.latency = m.inst->latency;
+            issueQueue.ready.erase(age);
+            m.generation = ++generation;
+            if(m.physicalDest1 != -1)
+            {
+                replayed[m.physicalDest1] = true;
+                scoreBoard[m.physicalDest1] = INF;
+            }
+            if(m.physicalDest2 != -1)
+            {
+                replayed[m.physicalDest2] = true;
+                scoreBoard[m.physicalDest2] = INF;
+            }
+            insertWaiting(m);
+        }
+    }
+
+    bool replaying()
+    {
+        return rob.endAge() < replayEnd;
+    }
+
+    // Squashed micro-ops are refetched first, then new ones come from the window. Either
+    // way the micro-op is left in the ROB slot it is about to take; NULL at the end.
+    MicroOp* fetchMicroOp(const TraceWindow &window)
+    {
+        if(replaying())
+        {
+            MicroOp &m = rob[rob.endAge()];
+            m.reset();
+            return &m;
+        }
+
+        if(totalMicroops + 1 == window.endAge || totalMicroops + 1 == fetchLimit)
+            return NULL;
+
+        MicroOp &m = rob[++totalMicroops];
+        m = window.ops[totalMicroops - window.firstAge];
+        if(totalMicroops == regionStart)
+            regionStartCycle = currentCycle;
+        return &m;
+    }
+
+    void renameMicroOp(MicroOp &microOp)
+    {
+        if(microOp.inst->archSrc1 != -1) microOp.physicalSrc1 = mapTable.mapping[microOp.inst->archSrc1];
+        if(microOp.inst->archSrc2 != -1) microOp.physicalSrc2 = mapTable.mapping[microOp.inst->archSrc2];
+        if(microOp.inst->archSrc3 != -1) microOp.physicalSrc3 = mapTable.mapping[microOp.inst->archSrc3];
+
+        if(microOp.inst->archDest1 != -1)
+        {
+            microOp.physicalRegToFree1 = mapTable.mapping[microOp.inst->archDest1];
+            int new_reg = mapTable.allocate();
+            mapTable.mapping[microOp.inst->archDest1] = new_reg;
+            microOp.physicalDest1 = new_reg;
+        }
+
+        if(microOp.inst->archDest2 != -1)
+        {
+            microOp.physicalRegToFree2 = mapTable.mapping[microOp.inst->archDest2];
+            int new_reg = mapTable.allocate();
+            mapTable.mapping[microOp.inst->archDest2] = new_reg;
+            microOp.physicalDest2 = new_reg;
+        }
+    }
+
+    // The ROB entry an event refers to, or NULL if it has committed or been squashed.
+    MicroOp* find(const IssueEvent &e)
+    {
+        if(!rob.contains(e.age))
+            return NULL;
+        MicroOp &m = rob[e.age];
+        return m.generation == e.generation ? &m : NULL;
+    }
+
+    // Puts m in the ready set once its sources are all ready, waiting on the consumer
+    // list of any whose producer has not issued yet.
+    void insertWaiting(MicroOp &m)
+    {
+        IssueEvent e = { m.age, m.generation };
+        int16_t srcs[3] = { m.physicalSrc1, m.physicalSrc2, m.physicalSrc3 };
+        m.pending = 0;
+        for(int i = 0; i < 3; i++)
+            if(srcs[i] != -1 && scoreBoard[srcs[i]] == INF)
+            {
+                issueQueue.consumers[srcs[i]].push_back(e);
+                m.pending++;
+            }
+        if(m.pending == 0)
+            scheduleReady(m);
+    }
+
+    void scheduleReady(MicroOp &m)
+    {
+        uint64_t cycle = 0;
+        if(m.physicalSrc1 != -1) cycle = max(cycle, scoreBoard[m.physicalSrc1]);
+        if(m.physicalSrc2 != -1) cycle = max(cycle, scoreBoard[m.physicalSrc2]);
+        if(m.physicalSrc3 != -1) cycle = max(cycle, scoreBoard[m.physicalSrc3]);
+        if(cycle <= currentCycle)
+            issueQueue.ready.insert(m.age);
+        else
+        {
+            IssueEvent e = { m.age, m.generation };
+            issueQueue.wakeups[cycle & issueQueue.wheelMask].push_back(e);
+        }
+    }
+
+    void wakeConsumers(int16_t reg)
+    {
+        if(reg == -1)
+            return;
+        vector<IssueEvent> &list = issueQueue.consumers[reg];
+        for(size_t i = 0; i < list.size(); i++)
+        {
+            MicroOp *m = find(list[i]);
+            if(m && --m->pending == 0)
+                scheduleReady(*m);
+        }
+        list.clear();
+    }
+
+    // Rebuilds the issue and load queues from the ROB, after restoring a snapshot. The
+    // wheel also covers micro-ops issued with an earlier, longer forwarding latency.
+    void rebuildIssueQueue()
+    {
+        int maxLatency = max(MAX_STATIC_LATENCY, forwardLatency);
+        for(uint64_t age = rob.headAge; age < rob.endAge(); age++)
+            maxLatency = max(maxLatency, rob[age].latency);
+        issueQueue.reset(maxLatency);
+        generation = 0;
+        loadQueue.issued.clear();
+        storeQueue.inFlight.clear();
+        for(uint64_t age = rob.headAge; age < rob.endAge(); age++)
+        {
+            MicroOp &m = rob[age];
+            m.generation = 0;
+            if(m.isStore && keepStores)
+                storeQueue.push(m.addressForMemoryOp, m.age);
+            if(!m.issued)
+                insertWaiting(m);
+            else if(predictor->speculates() && m.isLoad)
+                loadQueue.insert(m.addressForMemoryOp, m.age);
+            else if(predictor->speculates() && m.isStore && m.doneCycle >= currentCycle)
+            {
+                IssueEvent e = { m.age, 0 };
+                issueQueue.completing[m.doneCycle & issueQueue.wheelMask].push_back(e);
+            }
+        }
+    }
+
+    // Finds the oldest younger load to the same address as a store finishing this cycle
+    // that issued no later than the store did.
+    MicroOp* findViolation(MicroOp &store)
+    {
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = loadQueue.issued.find(store.addressForMemoryOp);
+        if(itr == loadQueue.issued.end())
+            return NULL;
+
+        uint64_t oldest = INF;
+        vector<uint64_t> &ages = itr->second;
+        for(size_t i = 0; i < ages.size(); i++)
+            if(ages[i] > store.age && ages[i] < oldest && rob.issueCycle[ages[i] & rob.mask] <= store.issueCycle)
+                oldest = ages[i];
+        return oldest == INF ? NULL : &rob[oldest];
+    }
+
+    // Selects up to N ready micro-ops, oldest first. Stores finishing this cycle are
+    // checked for violations in the same age order, so a violation older than the N-th
+    // selected micro-op squashes before anything younger issues. Returns true when a
+    // memory order violation squashed part of the ROB. With selective recovery nothing
+    // is squashed: every load the store caught is replayed with its dependents and
+    // selection goes on after the store.
+    template<class T> bool issue()
+    {
+        T &p = *static_cast<T*>(predictor);
+        vector<IssueEvent> &wakeups = issueQueue.wakeups[currentCycle & issueQueue.wheelMask];
+        for(size_t i = 0; i < wakeups.size(); i++)
+            if(find(wakeups[i]))
+                issueQueue.ready.insert(wakeups[i].age);
+        wakeups.clear();
+
+        vector<IssueEvent> &completing = issueQueue.completing[currentCycle & issueQueue.wheelMask];
+        vector<IssueEvent> stores;
+        stores.swap(completing);
+        if(rob.empty()) return false;
+
+        int count = 0;
+        size_t nextStore = 0;
+        set<uint64_t>::iterator itr = issueQueue.ready.begin();
+        while(true)
+        {
+            MicroOp *store = NULL;
+            while(nextStore < stores.size() && !(store = find(stores[nextStore])))
+                nextStore++;
+            uint64_t storeAge = store ? store->age : INF;
+            uint64_t readyAge = itr != issueQueue.ready.end() ? *itr : INF;
+            if(storeAge == INF && readyAge == INF)
+                break;
+
+            if(readyAge < storeAge)
+            {
+                MicroOp &microOp = rob[readyAge];
+                if(!memoryReady<T>(microOp))
+                {
+                    itr++;
+                    continue;
+                }
+                issueQueue.ready.erase(itr++);
+
+                if(microOp.isLoad && forwardLatency > 0 && forwards(microOp))
+                {
+                    microOp.forwarded = true;
+                    microOp.latency = forwardLatency;
+                }
+                rob.markIssued(microOp, currentCycle);
+                if(microOp.isStore)
+                    p.storeIssued(*this, microOp);
+
+                if(microOp.physicalDest1 != -1) scoreBoard[microOp.physicalDest1] = microOp.doneCycle;
+                if(microOp.physicalDest2 != -1) scoreBoard[microOp.physicalDest2] = microOp.doneCycle;
+                wakeConsumers(microOp.physicalDest1);
+                wakeConsumers(microOp.physicalDest2);
+                if(p.speculates() && microOp.isLoad)
+                    loadQueue.insert(microOp.addressForMemoryOp, microOp.age);
+                if(p.speculates() && microOp.isStore)
+                {
+                    IssueEvent e = { microOp.age, microOp.generation };
+                    issueQueue.completing[microOp.doneCycle & issueQueue.wheelMask].push_back(e);
+                }
+
+                if(++count == N)
+                    break;
+                continue;
+            }
+
+            //execute
+            nextStore++;
+            MicroOp *load = findViolation(*store);
+            if(load && !selectiveRecovery)
+            {
+                p.violation(load->inst->instructionAddress, store->inst->instructionAddress);
+                recoverMOV<T>(load->age);
+                return true;
+            }
+            if(load)
+            {
+                for(; load; load = findViolation(*store))
+                {
+                    p.violation(load->inst->instructionAddress, store->inst->instructionAddress);
+                    replayDependents<T>(load->age);
+                }
+                itr = issueQueue.ready.upper_bound(store->age);
+            }
+        }
+        return false;
+    }
+
+    template<class T> void commit()
+    {
+        T &p = *static_cast<T*>(predictor);
+        for(int i = 0; i < N; i++)
+        {
+            if(rob.empty()) return;
+
+            if(rob.doneCycle[rob.headAge & rob.mask] <= currentCycle)
+            {
+                MicroOp &microOp = rob.front();
+                microOp.commitCycle = currentCycle;
+                rob.pop_front();
+                if(microOp.isLoad && p.speculates())
+                    loadQueue.erase(microOp.addressForMemoryOp, microOp.age);
+                if(microOp.isStore && keepStores)
+                    storeQueue.popOldest(microOp.addressForMemoryOp);
+                if(microOp.isLoad || microOp.isStore)
+                    p.committed(*this, microOp);
+                if(microOp.forwarded && (samples.empty() || microOp.age >= regionStart))
+                    forwardedLoads++;
+
+                if(debug)
+                {
+                    fprintf(outputFile, "%" PRIu64 ": %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64, microOp.age, microOp.fetchCycle, microOp.issueCycle,
+                            microOp.doneCycle, microOp.commitCycle);
+
+                    if(microOp.physicalSrc1 != -1) fprintf(outputFile, ", r%d -> p%d", microOp.inst->archSrc1, microOp.physicalSrc1);
+                    if(microOp.physicalSrc2 != -1) fprintf(outputFile, ", r%d -> p%d", microOp.inst->archSrc2, microOp.physicalSrc2);
+                    if(microOp.physicalSrc3 != -1) fprintf(outputFile, ", r%d -> p%d", microOp.inst->archSrc3, microOp.physicalSrc3);
+
+                    if(microOp.physicalDest1 != -1) fprintf(outputFile, ", r%d -> p%d [p%d]", microOp.inst->archDest1, microOp.physicalDest1, microOp.physicalRegToFree1);
+                    if(microOp.physicalDest2 != -1) fprintf(outputFile, ", r%d -> p%d [p%d]", microOp.inst->archDest2, microOp.physicalDest2, microOp.physicalRegToFree2);
+
+                    fprintf(outputFile, " | %s %s\n", microOp.inst->macroOperation, microOp.inst->microOperation);
+                }
+
+                if(microOp.physicalRegToFree1 != -1) mapTable.release(microOp.physicalRegToFree1);
+                if(microOp.physicalRegToFree2 != -1) mapTable.release(microOp.physicalRegToFree2);
+            }
+            else return;
+        }
+    }
+
+    // Jumps over cycles in which nothing can happen: called when fetch cannot proceed,
+    // it moves currentCycle to the first cycle with a micro-op ready to select, a wakeup
+    // or finishing store on the wheel, or the ROB head done.
+    void skipIdleCycles()
+    {
+        if(!issueQueue.ready.empty() || rob.empty())
+            return;
+        uint64_t next = rob.doneCycle[rob.headAge & rob.mask];
+        for(uint64_t cycle = currentCycle; cycle <= currentCycle + issueQueue.wheelMask && cycle < next; cycle++)
+            if(!issueQueue.wakeups[cycle & issueQueue.wheelMask].empty() || !issueQueue.completing[cycle & issueQueue.wheelMask].empty())
+                next = cycle;
+        if(next != INF && next > currentCycle)
+            currentCycle = next;
+    }
+
+    template<class T> bool fetchRename(const TraceWindow &window)
+    {
+        T &p = *static_cast<T*>(predictor);
+        for(int i = 0; i < N; i++)
+        {
+            if(rob.full())
+                break;
+
+            MicroOp *fetched = fetchMicroOp(window);
+            if(!fetched)
+                return true;
+
+            MicroOp &microOp = *fetched;
+            microOp.fetchCycle = currentCycle;
+            microOp.generation = generation;
+            if(microOp.isLoad && p.speculates())
+                mapTable.save(checkpoints[microOp.age & rob.mask]);
+            renameMicroOp(microOp);
+            if(microOp.isLoad || microOp.isStore)
+                p.renamed(*this, microOp);
+            if(keepStores && microOp.isStore)
+                storeQueue.push(microOp.addressForMemoryOp, microOp.age);
+            rob.append(microOp.age);
+            if(microOp.physicalDest1 != -1) scoreBoard[microOp.physicalDest1] = INF;
+            if(microOp.physicalDest2 != -1) scoreBoard[microOp.physicalDest2] = INF;
+            insertWaiting(microOp);
+        }
+
+        return false;
+    }
+
+    // Functional fast-forward: renames (committing at once) and trains the predictor
+    // on every load that reads a store from within one fetch group's distance, the
+    // pairs that almost always violate in the detailed run. Training on anything the
+    // ROB could hold makes the sets far too large.
+    template<class T> void fastForwardMicroOp(MicroOp m)
+    {
+        renameMicroOp(m);
+        if(m.physicalRegToFree1 != -1) mapTable.release(m.physicalRegToFree1);
+        if(m.physicalRegToFree2 != -1) mapTable.release(m.physicalRegToFree2);
+
+        if(!(m.isLoad || m.isStore))
+            return;
+        RecentStore &recent = recentStores[(m.addressForMemoryOp >> 3) & (RECENT_STORES - 1)];
+        if(m.isStore)
+        {
+            recent.address = m.addressForMemoryOp;
+            recent.pc = m.inst->instructionAddress;
+            recent.age = m.age;
+        }
+        else if(recent.age != 0 && recent.address == m.addressForMemoryOp && m.age - recent.age < uint64_t(N))
+            static_cast<T*>(predictor)->violation(m.inst->instructionAddress, recent.pc);
+    }
+
+    // Fast-forwards up to the next sample. Returns false when the window runs out first.
+    template<class T> bool fastForward(const TraceWindow &window)
+    {
+        while(true)
+        {
+            uint64_t next = totalMicroops + 1;
+            if(sampleIndex < samples.size() && next >= samples[sampleIndex].warmup)
+            {
+                fastForwarding = false;
+                fetchLimit = samples[sampleIndex].end;
+                regionStart = samples[sampleIndex].start;
+                return true;
+            }
+            if(next == window.endAge)
+            {
+                done = window.last;
+                return window.last;
+            }
+
+            if(totalMicroops%1000000==0)
+                static_cast<T*>(predictor)->clear();
+            fastForwardMicroOp<T>(window.ops[next - window.firstAge]);
+            totalMicroops++;
+        }
+    }
+
+    // End of a sample: drain the ROB (refetching anything a late violation squashes),
+    // record its cycles and go back to fast-forwarding.
+    template<class T> void endSample(const TraceWindow &window)
+    {
+        samples[sampleIndex].fetchCycles = currentCycle - regionStartCycle;
+        currentCycle++;
+        while(!rob.empty() || replaying())
+        {
+            commit<T>();
+            if(!issue<T>())
+                fetchRename<T>(window);
+            currentCycle++;
+            if(!replaying() || rob.full())
+                skipIdleCycles();
+        }
+
+        SamplePoint &sample = samples[sampleIndex++];
+        sample.cycles = currentCycle - regionStartCycle;
+        sample.microops = totalMicroops - (sample.start - 1);
+        fastForwarding = true;
+        regionStart = INF;
+        fetchLimit = INF;
+    }
+
+    // Runs cycles until the window cannot supply a full fetch group, or to the end of
+    // the trace (and the ROB drained) if this is the last window.
+    template<class T> void run(const TraceWindow &window)
+    {
+        while(!done)
+        {
+            if(fastForwarding)
+            {
+                if(!fastForward<T>(window))
+                    return;
+                continue;
+            }
+
+            if(!window.last && window.endAge - (totalMicroops + 1) < uint64_t(N) && fetchLimit > window.endAge)
+                return;
+
+            if(totalMicroops%1000000==0)
+                static_cast<T*>(predictor)->clear();
+            bool eof = false;
+            commit<T>();
+            bool skipFetch = issue<T>();
+            if(!skipFetch)
+                eof = fetchRename<T>(window);
+            if(eof && totalMicroops + 1 == fetchLimit && !(window.last && fetchLimit == window.endAge))
+            {
+                endSample<T>(window);
+                continue;
+            }
+            currentCycle++;
+            if(eof)
+                done = true;
+            else if(rob.full())
+                skipIdleCycles();
+        }
+
+        while(!rob.empty())
+        {
+            commit<T>();
+            issue<T>();
+            currentCycle++;
+            skipIdleCycles();
+        }
+        if(!samples.empty() && !fastForwarding && sampleIndex < samples.size())
+        {
+            // the trace ended inside (or right at the end of) a sample
+            SamplePoint &sample = samples[sampleIndex++];
+            sample.cycles = currentCycle - regionStartCycle;
+            sample.fetchCycles = sample.cycles;
+            sample.microops = totalMicroops - (sample.start - 1);
+            fastForwarding = true;
+        }
+    }
+
+    // The pipeline is compiled once per predictor class, so the predictor's checks in the
+    // issue loop inline; the configuration's predictor picks the instance once per window.
+    void simulate(const TraceWindow &window)
+    {
+        (this->*type->run)(window);
+    }
+
+    void serialize(Snapshot &s, StaticTable &table)
+    {
+        string name = type->name;
+        s.io(name);
+        if(s.reading)
+        {
+            const PredictorType *t = findPredictor(name);
+            if(!t)
+            {
+                fprintf(stderr, "Error reading snapshot: unknown predictor %s\n", name.c_str());
+                abort();
+            }
+            type = t;
+        }
+        uint32_t robSize = rob.maxMicroOps;
+        s.io(robSize);
+        s.io(scoreBoard.readyCycle);
+        s.io(mapTable.mapping);
+        s.io(mapTable.freeList);
+        s.io(mapTable.freeHead);
+        s.io(mapTable.freeTail);
+
+        // the ROB's micro-ops, then any squashed ones waiting in the slots after them
+        size_t n = s.ioSize(rob.count);
+        if(s.reading)
+            rob.reset(robSize);
+        s.io(rob.headAge);
+        s.io(replayEnd);
+        for(uint64_t age = rob.headAge; age < max(rob.headAge + n, replayEnd); age++)
+            rob[age].serialize(s, table);
+        if(s.reading)
+            for(uint64_t age = rob.headAge; age < rob.headAge + n; age++)
+                rob.append(age);
+        s.io(checkpoints);
+
+        s.io(forwardLatency);
+        s.io(forwardedLoads);
+        s.io(selectiveRecovery);
+        if(s.reading)
+            setPredictor(type);
+        predictor->serialize(s);
+        s.io(currentCycle);
+        s.io(totalMicroops);
+        s.io(skipped);
+        s.io(done);
+        s.io(samples);
+        s.io(sampleIndex);
+        s.io(fastForwarding);
+        s.io(regionStart);
+        s.io(regionStartCycle);
+        s.io(fetchLimit);
+        s.io(recentStores);
+        if(s.reading)
+            rebuildIssueQueue();
+    }
+
+    void printResult(const char *label)
+    {
+        char forwarded[64] = "";
+        if(forwardLatency > 0)
+            snprintf(forwarded, sizeof(forwarded), " Forwarded loads: %" PRIu64, forwardedLoads);
+        if(samples.empty())
+        {
+            fprintf(outputFile, "%sTotal cycles: %" PRIu64 " Total MicroOps: %" PRIu64 " IPC: %f%s\n", label, currentCycle, totalMicroops - skipped, double(totalMicroops - skipped) / currentCycle, forwarded);
+            return;
+        }
+
+        // weighted CPI over the samples that were reached, scaled to the whole trace
+        double cpi = 0, weight = 0;
+        for(size_t i = 0; i < samples.size(); i++)
+            if(samples[i].microops > 0)
+            {
+                cpi += samples[i].weight * samples[i].cycles / samples[i].microops;
+                weight += samples[i].weight;
+            }
+        cpi = weight > 0 ? cpi / weight : 0;
+        fprintf(outputFile, "%sTotal cycles: %" PRIu64 " Total MicroOps: %" PRIu64 " IPC: %f (SimPoint estimate, %" PRIu64 " cycles simulated)%s\n",
+                label, uint64_t(cpi * (totalMicroops - skipped) + 0.5), totalMicroops - skipped, cpi > 0 ? 1 / cpi : 0, currentCycle, forwarded);
+    }
+};
+
+// nospec: loads wait for every older store.
+struct NoSpecPredictor final : Predictor
+{
+    bool speculates() { return false; }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        if(!m.isLoad)
+            return false;
+        ROB &rob = sim.rob;
+        for(uint64_t age = rob.headAge; age < m.age; age++)
+        {
+            size_t i = age & rob.mask;
+            if((rob.flags[i] & ROB_STORE) && !((rob.flags[i] & ROB_ISSUED) && rob.doneCycle[i] <= sim.currentCycle))
+                return true;
+        }
+        return false;
+    }
+};
+
+// naive: loads never wait, violations squash.
+struct NaivePredictor final : Predictor
+{
+};
+
+// perfect: loads wait only for older stores to the same address.
+struct PerfectPredictor final : Predictor
+{
+    bool speculates() { return false; }
+    bool needsStoreQueue() { return true; }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        if(!m.isLoad)
+            return false;
+        unordered_map<uint64_t, vector<uint64_t> >::iterator itr = sim.storeQueue.inFlight.find(m.addressForMemoryOp);
+        if(itr == sim.storeQueue.inFlight.end())
+            return false;
+        ROB &rob = sim.rob;
+        vector<uint64_t> &ages = itr->second;
+        for(size_t j = 0; j < ages.size() && ages[j] < m.age; j++)
+        {
+            size_t i = ages[j] & rob.mask;
+            if(!((rob.flags[i] & ROB_ISSUED) && rob.doneCycle[i] <= sim.currentCycle))
+                return true;
+        }
+        return false;
+    }
+};
+
+// ss2: store sets, infinite configuration. A load waits for any older store still to
+// issue whose PC is in its set.
+struct StoreSetPredictor final : Predictor
+{
+    FlatTable<pair<uint64_t, uint64_t>, bool> storeSets;  // (load PC, store PC) in its set
+    FlatTable<uint64_t, uint32_t> storeSetSizes;          // load PC -> store PCs in its set
+
+    StoreSetPredictor()
+    {
+        storeSets.reset(storeSetEntries);
+        storeSetSizes.reset(storeSetEntries);
+    }
+
+    void clear()
+    {
+        storeSets.clear();
+        storeSetSizes.clear();
+    }
+
+    void serialize(Snapshot &s)
+    {
+        storeSets.serialize(s);
+        storeSetSizes.serialize(s);
+    }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        uint64_t loadPC = m.inst->instructionAddress;
+        if(!m.isLoad || !storeSetSizes.find(loadPC))
+            return false;
+        ROB &rob = sim.rob;
+        for(uint64_t age = rob.headAge; age < m.age; age++)
+        {
+            size_t i = age & rob.mask;
+            if((rob.flags[i] & ROB_STORE) && rob.issueCycle[i] >= sim.currentCycle && storeSets.find(make_pair(loadPC, rob.pc[i])))
+                return true;
+        }
+        return false;
+    }
+
+    void violation(uint64_t loadPC, uint64_t storePC)
+    {
+        if(storeSets.find(make_pair(loadPC, storePC)))
+            return;
+        const pair<uint64_t, uint64_t> *evicted;
+        storeSets.insert(make_pair(loadPC, storePC), &evicted);
+        if(evicted)
+            shrinkSet(evicted->first);
+        storeSetSizes.insert(loadPC)++;
+    }
+
+    void shrinkSet(uint64_t loadPC)
+    {
+        uint32_t *size = storeSetSizes.find(loadPC);
+        if(size && --*size == 0)
+            storeSetSizes.erase(loadPC);
+    }
+};
+
+// ss3: a load depends upon one store, the last one it violated with.
+struct OneStorePredictor final : Predictor
+{
+    FlatTable<uint64_t, uint64_t> storeSet;  // load PC -> store PC
+
+    OneStorePredictor()
+    {
+        storeSet.reset(storeSetEntries);
+    }
+
+    void clear()
+    {
+        storeSet.clear();
+    }
+
+    void serialize(Snapshot &s)
+    {
+        storeSet.serialize(s);
+    }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        uint64_t *storePC = m.isLoad ? storeSet.find(m.inst->instructionAddress) : NULL;
+        if(!storePC)
+            return false;
+        ROB &rob = sim.rob;
+        for(uint64_t age = rob.headAge; age < m.age; age++)
+        {
+            size_t i = age & rob.mask;
+            if((rob.flags[i] & ROB_STORE) && rob.pc[i] == *storePC && rob.issueCycle[i] >= sim.currentCycle)
+                return true;
+        }
+        return false;
+    }
+
+    void violation(uint64_t loadPC, uint64_t storePC)
+    {
+        storeSet.insert(loadPC) = storePC;
+    }
+};
+
+// ss4: a store belongs to one load's set. Each load and store PC's slot in pcIds is its
+// ID. A store belongs to the set of the load that owns it, or with ss4Merge, sets are
+// merged in a union-find over the IDs (parent, rank). trained marks loads that may own
+// stores, or IDs merged.
+struct OneSetPredictor final : Predictor
+{
+    FlatTable<uint64_t, bool> pcIds;
+    vector<uint32_t> owner;
+    vector<uint32_t> parent;
+    vector<uint8_t> rank;
+    vector<uint8_t> trained;
+    bool merge;
+
+    OneSetPredictor()
+    {
+        pcIds.reset(storeSetEntries);
+        owner.assign(pcIds.entries.size(), 0);
+        parent.assign(pcIds.entries.size(), 0);
+        rank.assign(pcIds.entries.size(), 0);
+        trained.assign(pcIds.entries.size(), 0);
+        merge = ss4Merge;
+    }
+
+    void clear()
+    {
+        pcIds.clear();
+    }
+
+    void serialize(Snapshot &s)
+    {
+        pcIds.serialize(s);
+        s.io(owner);
+        s.io(parent);
+        s.io(rank);
+        s.io(trained);
+        s.io(merge);
+    }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        if(!m.isLoad)
+            return false;
+        size_t load = pcIds.findSlot(m.inst->instructionAddress);
+        if(load == pcIds.entries.size() || !trained[load])
+            return false;
+        ROB &rob = sim.rob;
+        for(uint64_t age = rob.headAge; age < m.age; age++)
+        {
+            size_t i = age & rob.mask;
+            if((rob.flags[i] & ROB_STORE) && rob.issueCycle[i] >= sim.currentCycle && inLoadSet(load, rob.pc[i]))
+                return true;
+        }
+        return false;
+    }
+
+    void violation(uint64_t loadPC, uint64_t storePC)
+    {
+        uint32_t load = pcId(loadPC), store = pcId(storePC);
+        trained[load] = 1;
+        if(merge)
+        {
+            trained[store] = 1;
+            mergeSets(load, store);
+        }
+        else
+            owner[store] = load;
+    }
+
+    // A new ID starts out in no set, as its own union-find root.
+    uint32_t pcId(uint64_t pc)
+    {
+        bool added;
+        uint32_t id = pcIds.insertSlot(pc, &added);
+        if(added)
+        {
+            owner[id] = NO_OWNER;
+            parent[id] = id;
+            rank[id] = trained[id] = 0;
+        }
+        return id;
+    }
+
+    uint32_t findSet(uint32_t id)
+    {
+        uint32_t root = id;
+        while(parent[root] != root)
+            root = parent[root];
+        while(parent[id] != root)
+        {
+            uint32_t next = parent[id];
+            parent[id] = root;
+            id = next;
+        }
+        return root;
+    }
+
+    void mergeSets(uint32_t a, uint32_t b)
+    {
+        a = findSet(a);
+        b = findSet(b);
+        if(a == b)
+            return;
+        if(rank[a] < rank[b])
+            swap(a, b);
+        parent[b] = a;
+        if(rank[a] == rank[b])
+            rank[a]++;
+    }
+
+    bool inLoadSet(uint32_t load, uint64_t storePC)
+    {
+        size_t store = pcIds.findSlot(storePC);
+        if(store == pcIds.entries.size())
+            return false;
+        if(merge)
+            return trained[store] && findSet(store) == findSet(load);
+        return owner[store] == load;
+    }
+};
+
+// sst: Store Set ID Table and Last Fetched Store Table (Chrysos and Emer). A load or
+// store in a store set waits for the last store of its set fetched before it, and a
+// store becomes that last store until it issues.
+struct StoreSetTablePredictor final : Predictor
+{
+    vector<int32_t> ssit;     // store set ID by load/store PC, -1 if none
+    vector<uint64_t> lfst;    // age of the last fetched store by store set, INF if none
+    bool folded;
+
+    StoreSetTablePredictor()
+    {
+        ssit.assign(roundUp(ssitEntries), -1);
+        lfst.assign(roundUp(lfstEntries), INF);
+        folded = ssitFolded;
+    }
+
+    void clear()
+    {
+        ssit.assign(ssit.size(), -1);
+    }
+
+    void serialize(Snapshot &s)
+    {
+        s.io(ssit);
+        s.io(lfst);
+        s.io(folded);
+    }
+
+    size_t ssitIndex(uint64_t pc)
+    {
+        if(folded)
+            pc ^= pc >> __builtin_ctzll(ssit.size());
+        return pc & (ssit.size() - 1);
+    }
+
+    bool mustWait(Simulator &sim, MicroOp &m)
+    {
+        return m.storeDependence != INF && sim.rob.contains(m.storeDependence) &&
+            sim.rob.issueCycle[m.storeDependence & sim.rob.mask] >= sim.currentCycle;
+    }
+
+    void renamed(Simulator &, MicroOp &m)
+    {
+        m.ssid = ssit[ssitIndex(m.inst->instructionAddress)];
+        if(m.ssid < 0)
+            return;
+        m.storeDependence = lfst[m.ssid];
+        if(m.isStore)
+            lfst[m.ssid] = m.age;
+    }
+
+    void storeIssued(Simulator &, MicroOp &m)
+    {
+        if(m.ssid >= 0 && lfst[m.ssid] == m.age)
+            lfst[m.ssid] = INF;
+    }
+
+    void squashed(Simulator &, MicroOp &m)
+    {
+        if(m.isStore && m.ssid >= 0 && lfst[m.ssid] == m.age)
+            lfst[m.ssid] = INF;
+    }
+
+    // a new set is named after the load's SSIT entry; two sets merge into the smaller
+    void violation(uint64_t loadPC, uint64_t storePC)
+    {
+        int32_t &loadSet = ssit[ssitIndex(loadPC)];
+        int32_t &storeSet = ssit[ssitIndex(storePC)];
+        if(loadSet < 0 && storeSet < 0)
+            loadSet = storeSet = ssitIndex(loadPC) & (lfst.size() - 1);
+        else if(loadSet < 0)
+            loadSet = storeSet;
+        else if(storeSet < 0)
+            storeSet = loadSet;
+        else
+            loadSet = storeSet = min(loadSet, storeSet);
+    }
+};
+
+template<class T> Predictor* createPredictor()
+{
+    static_assert(matchesHook<T, WaitHook>(&T::mustWait), "mustWait does not match Predictor's");
+    static_assert(matchesHook<T, NotifyHook>(&T::renamed), "renamed does not match Predictor's");
+    static_assert(matchesHook<T, NotifyHook>(&T::storeIssued), "storeIssued does not match Predictor's");
+    static_assert(matchesHook<T, NotifyHook>(&T::squashed), "squashed does not match Predictor's");
+    static_assert(matchesHook<T, NotifyHook>(&T::committed), "committed does not match Predictor's");
+    static_assert(matchesHook<T, TrainHook>(&T::violation), "violation does not match Predictor's");
+    return new T;
+}
+
+// The predictors --predictor= and the configuration prefixes choose from.
+const PredictorType predictorTypes[] =
+{
+    { "nospec",  createPredictor<NoSpecPredictor>,        &Simulator::run<NoSpecPredictor> },
+    { "naive",   createPredictor<NaivePredictor>,         &Simulator::run<NaivePredictor> },
+    { "perfect", createPredictor<PerfectPredictor>,       &Simulator::run<PerfectPredictor> },
+    { "ss2",     createPredictor<StoreSetPredictor>,      &Simulator::run<StoreSetPredictor> },
+    { "ss3",     createPredictor<OneStorePredictor>,      &Simulator::run<OneStorePredictor> },
+    { "ss4",     createPredictor<OneSetPredictor>,        &Simulator::run<OneSetPredictor> },
+    { "sst",     createPredictor<StoreSetTablePredictor>, &Simulator::run<StoreSetTablePredictor> },
+};
+const int NUM_PREDICTORS = sizeof(predictorTypes) / sizeof(predictorTypes[0]);
+
+const PredictorType* findPredictor(const string &name)
+{
+    for(int i = 0; i < NUM_PREDICTORS; i++)
+        if(name == predictorTypes[i].name)
+            return &predictorTypes[i];
+    return NULL;
+}
+
+// Everything needed to resume a run: the shared window and static table, every
+// configuration, and last the trace position (restoring it seeks the trace there).
+void serializeRun(Snapshot &s, TraceReader &trace, TraceWindow &window, vector<Simulator*> &sims)
+{
+    char magic[8];
+    memcpy(magic, SNAPSHOT_MAGIC, 8);
+    s.io(magic);
+    if(memcmp(magic, SNAPSHOT_MAGIC, 8) != 0)
+    {
+        fprintf(stderr, "Error reading snapshot: not a snapshot file");
+        abort();
+    }
+
+    size_t n = s.ioSize(sims.size());
+    while(sims.size() < n)
+    {
+        sims.push_back(new Simulator);
+        sims.back()->reset(&predictorTypes[0], 1, stdout);
+    }
+
+    window.serialize(s);
+    for(size_t i = 0; i < n; i++)
+        sims[i]->serialize(s, window.staticTable);
+    trace.serialize(s);
+}
+
+// Written to a temporary file first, so a crash while saving leaves the previous
+// snapshot intact.
+void saveSnapshot(const char *name, TraceReader &trace, TraceWindow &window, vector<Simulator*> &sims)
+{
+    string tmp = string(name) + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Error opening snapshot %s\n", tmp.c_str());
+        abort();
+    }
+    Snapshot s = { file, false };
+    serializeRun(s, trace, window, sims);
+    fclose(file);
+    rename(tmp.c_str(), name);
+}
+
+// Reads the output of the simpoint tool: a "# interval <uops>" header followed by one
+// "<interval> <weight>" line per chosen interval.
+bool readSimPoints(const char *name, vector<SamplePoint> &samples)
+{
+    FILE *file = fopen(name, "r");
+    uint64_t interval = 0;
+    if(file == NULL || fscanf(file, " # interval %" SCNu64, &interval) != 1 || interval == 0)
+    {
+        fprintf(stderr, "Error reading simpoints %s\n", name);
+        return false;
+    }
+
+    uint64_t index;
+    double weight;
+    while(fscanf(file, "%" SCNu64 " %lf", &index, &weight) == 2)
+    {
+        SamplePoint sample = { index * interval + 1, (index + 1) * interval + 1, weight, 0, 0, 0, 0 };
+        samples.push_back(sample);
+    }
+    fclose(file);
+    sort(samples.begin(), samples.end(), compareSamples);
+    return true;
+}
+
+uint64_t countMicroOps(const char *traceName)
+{
+    FILE *inputFile = fopen(traceName, "rb");
+    if(inputFile == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", traceName);
+        abort();
+    }
+    TraceReader trace;
+    trace.open(inputFile);
+    TraceRecord r;
+    uint64_t count = 0;
+    while(trace.next(r))
+        count++;
+    return count;
+}
+
+// Starts a run at the micro-op of the given age: seeks there through the index if
+// there is one, otherwise decodes and drops everything before it.
+void startAt(TraceReader &trace, const TraceIndex *index, uint64_t age, TraceWindow &window, vector<Simulator*> &sims)
+{
+    if(index)
+        trace.seekAge(*index, age);
+    else
+        trace.skip(age - 1);
+    window.firstAge = window.endAge = age;
+    for(size_t i = 0; i < sims.size(); i++)
+        sims[i]->totalMicroops = sims[i]->skipped = age - 1;
+}
+
+// One thread of a --parallel run: reads the trace on its own and runs its simulators,
+// which each have a single sample, until they have all finished it. With an index it
+// seeks straight to the warmup instead of fast-forwarding to it.
+void simulateInterval(const char *traceName, const TraceIndex *index, vector<Simulator*> *sims)
+{
+    FILE *inputFile = fopen(traceName, "rb");
+    if(inputFile == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", traceName);
+        abort();
+    }
+    TraceReader trace;
+    trace.open(inputFile);
+    TraceWindow window;
+    startAt(trace, index, (*sims)[0]->samples[0].warmup, window, *sims);
+
+    bool finished;
+    do
+    {
+        window.refill(trace);
+        finished = true;
+        for(size_t i = 0; i < sims->size(); i++)
+        {
+            (*sims)[i]->simulate(window);
+            if((*sims)[i]->sampleIndex < (*sims)[i]->samples.size())
+                finished = false;
+        }
+    } while(!finished && !window.last);
+}
+
+// Stitches the intervals of a --parallel run: each one contributes the cycles from
+// fetching its first micro-op to fetching the next interval's, the last one also its
+// drain. Where the boundaries really fall is uncertain by up to the drain time.
+void printStitchedResult(FILE *outputFile, const char *label, const vector<Simulator*> &parts)
+{
+    uint64_t cycles = 0, microops = 0, error = 0, forwardedLoads = 0;
+    for(size_t i = 0; i < parts.size(); i++)
+    {
+        const SamplePoint &sample = parts[i]->samples[0];
+        forwardedLoads += parts[i]->forwardedLoads;
+        bool last = i + 1 == parts.size();
+        cycles += last ? sample.cycles : sample.fetchCycles;
+        microops += sample.microops;
+        if(!last)
+            error += sample.cycles - sample.fetchCycles;
+    }
+    char forwarded[64] = "";
+    if(parts[0]->forwardLatency > 0)
+        snprintf(forwarded, sizeof(forwarded), " Forwarded loads: %" PRIu64, forwardedLoads);
+    fprintf(outputFile, "%sTotal cycles: %" PRIu64 " Total MicroOps: %" PRIu64 " IPC: %f (%u intervals, +-%" PRIu64 " cycles)%s\n",
+            label, cycles, microops, double(microops) / cycles, unsigned(parts.size()), error, forwarded);
+}
+
+// Usage: <binary> <configs> [trace file] [options]
+//
+// configs is a comma separated list of ROB sizes, each optionally prefixed with a
+// predictor name, e.g. "128,256" or "ss2:128,perfect:128,naive:512". Unprefixed sizes
+// use --predictor, or else the binary's own predictor. The trace is decoded once and fed to every configuration,
+// and each prints its own result line (labelled when there is more than one).
+//
+// Options:
+//   --predictor=<name>     predictor for unprefixed sizes: nospec, naive, perfect, ss2, ss3,
+//                          ss4 or sst (see predictorTypes)
+//   --save=<file>          snapshot file to write
+//   --save-every=<uops>    rewrite the snapshot every so many decoded micro-ops
+//   --save-at=<uops>       write the snapshot once that many micro-ops are decoded, then exit
+//   --restore=<file>       resume from a snapshot; the configurations come from it, so the
+//                          only other argument is the (same) trace. --forward and --recovery
+//                          apply from there on; options that shape the saved state (the
+//                          predictor and its tables, samples, start) are rejected
+//   --simpoints=<file>     time only the intervals chosen by the simpoint tool, fast-forward
+//                          between them, and report the weighted IPC
+//   --parallel=<threads>   split the trace into that many intervals, simulate each on its
+//                          own thread and stitch the cycle counts together
+//   --warmup=<uops>        simulate this many micro-ops in detail, untimed, before each
+//                          sampled or parallel interval (default 100000)
+//   --index=<file>         seek index built by traceindex, used by --start and --parallel
+//   --start=<uops>         start simulating at this micro-op (the first is 1)
+//   --ss-entries=<n>       capacity of each ss2/ss3/ss4 store set table (default 65536)
+//   --forward=<cycles>     model store to load forwarding: a load issuing after the youngest
+//                          older store to its address has executed takes this latency (at
+//                          most MAX_FORWARD_LATENCY), and the forwarded loads are counted
+//                          (default off)
+//   --recovery=selective   on a memory order violation re-execute only the load and what
+//                          depends on it through registers (default: squash and refetch)
+//   --ss4-merge            ss4 merges the load's and store's sets on a violation, as in the
+//                          published store set algorithm, instead of moving the store
+//   --ssit=<entries>       sst Store Set ID Table size (default 4096)
+//   --lfst=<entries>       sst Last Fetched Store Table size, i.e. store sets (default 128)
+//   --ssit-index=pc|fold   index the SSIT by the low PC bits (default) or by the PC
+//                          folded onto itself
+//
+// Snapshots are taken between windows, so positions are rounded up to WINDOW_SIZE.
+int simMain(int argc, char *argv[], const char *defaultPredictor)
+{
+    const char *saveName = NULL, *restoreName = NULL, *simpointsName = NULL, *indexName = NULL;
+    uint64_t saveEvery = 0, saveAt = 0, warmup = 100000, start = 1;
+    unsigned threads = 0;
+    bool forwardGiven = false, recoveryGiven = false;
+    const char *stateOption = NULL;  // the last option a snapshot's state already fixes
+    vector<const char*> args;
+    for(int i = 1; i < argc; i++)
+    {
+        if(strncmp(argv[i], "--predictor=", 12) == 0 || strncmp(argv[i], "--simpoints=", 12) == 0 ||
+           strncmp(argv[i], "--warmup=", 9) == 0 || strncmp(argv[i], "--index=", 8) == 0 ||
+           strncmp(argv[i], "--start=", 8) == 0 || strncmp(argv[i], "--ss-entries=", 13) == 0 ||
+           strcmp(argv[i], "--ss4-merge") == 0 || strncmp(argv[i], "--ssit", 6) == 0 || strncmp(argv[i], "--lfst=", 7) == 0)
+            stateOption = argv[i];
+        forwardGiven |= strncmp(argv[i], "--forward=", 10) == 0;
+        recoveryGiven |= strncmp(argv[i], "--recovery=", 11) == 0;
+
+        if(strncmp(argv[i], "--predictor=", 12) == 0)
+            defaultPredictor = argv[i] + 12;
+        else if(strncmp(argv[i], "--save=", 7) == 0)
+            saveName = argv[i] + 7;
+        else if(strncmp(argv[i], "--save-every=", 13) == 0)
+            sscanf(argv[i] + 13, "%" SCNu64, &saveEvery);
+        else if(strncmp(argv[i], "--save-at=", 10) == 0)
+            sscanf(argv[i] + 10, "%" SCNu64, &saveAt);
+        else if(strncmp(argv[i], "--restore=", 10) == 0)
+            restoreName = argv[i] + 10;
+        else if(strncmp(argv[i], "--simpoints=", 12) == 0)
+            simpointsName = argv[i] + 12;
+        else if(strncmp(argv[i], "--parallel=", 11) == 0)
+            sscanf(argv[i] + 11, "%u", &threads);
+        else if(strncmp(argv[i], "--warmup=", 9) == 0)
+            sscanf(argv[i] + 9, "%" SCNu64, &warmup);
+        else if(strncmp(argv[i], "--index=", 8) == 0)
+            indexName = argv[i] + 8;
+        else if(strncmp(argv[i], "--start=", 8) == 0)
+            sscanf(argv[i] + 8, "%" SCNu64, &start);
+        else if(strncmp(argv[i], "--ss-entries=", 13) == 0)
+            sscanf(argv[i] + 13, "%d", &storeSetEntries);
+        else if(strncmp(argv[i], "--forward=", 10) == 0)
+            sscanf(argv[i] + 10, "%d", &forwardLatency);
+        else if(strncmp(argv[i], "--recovery=", 11) == 0)
+            selectiveRecovery = strcmp(argv[i] + 11, "selective") == 0;
+        else if(strcmp(argv[i], "--ss4-merge") == 0)
+            ss4Merge = true;
+        else if(strncmp(argv[i], "--ssit=", 7) == 0)
+            sscanf(argv[i] + 7, "%d", &ssitEntries);
+        else if(strncmp(argv[i], "--lfst=", 7) == 0)
+            sscanf(argv[i] + 7, "%d", &lfstEntries);
+        else if(strncmp(argv[i], "--ssit-index=", 13) == 0)
+            ssitFolded = strcmp(argv[i] + 13, "fold") == 0;
+        else
+            args.push_back(argv[i]);
+    }
+    if(forwardLatency < 0 || forwardLatency > MAX_FORWARD_LATENCY)
+    {
+        fprintf(stderr, "Error: --forward must be 0 (off) to %d cycles\n", MAX_FORWARD_LATENCY);
+        return 1;
+    }
+    if(restoreName && stateOption)
+    {
+        fprintf(stderr, "Error: %s cannot be changed on --restore; the snapshot's configuration is used\n", stateOption);
+        return 1;
+    }
+    size_t arg = 0;
+    string configs = !restoreName && arg < args.size() ? args[arg++] : "128";
+    const char *traceName = arg < args.size() ? args[arg++] : NULL;
+
+    vector<const PredictorType*> types;
+    vector<int> sizes;
+    for(size_t start = 0; !restoreName && start <= configs.size(); )
+    {
+        size_t end = configs.find(',', start);
+        if(end == string::npos)
+            end = configs.size();
+        string config = configs.substr(start, end - start);
+        start = end + 1;
+
+        string name = defaultPredictor ? defaultPredictor : "";
+        size_t colon = config.find(':');
+        if(colon != string::npos)
+        {
+            name = config.substr(0, colon);
+            config = config.substr(colon + 1);
+        }
+        const PredictorType *type = findPredictor(name);
+        if(!type)
+        {
+            if(name.empty())
+                fprintf(stderr, "No predictor given; use --predictor=<name> with one of:");
+            else
+                fprintf(stderr, "Unknown predictor %s; one of:", name.c_str());
+            for(int p = 0; p < NUM_PREDICTORS; p++)
+                fprintf(stderr, " %s", predictorTypes[p].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+
+        int robSize = 128;
+        sscanf(config.c_str(), "%d", &robSize);
+        types.push_back(type);
+        sizes.push_back(robSize);
+    }
+
+    // the trace comes from stdin unless a file is named; a regular file is mmapped
+    FILE *inputFile = stdin;
+    if(traceName && (inputFile = fopen(traceName, "rb")) == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", traceName);
+        return 1;
+    }
+
+    vector<SamplePoint> samples;
+    if(simpointsName && !readSimPoints(simpointsName, samples))
+        return 1;
+    // a run from --start only times the samples, or the part of one, after it
+    while(!samples.empty() && samples[0].end <= start)
+        samples.erase(samples.begin());
+    if(!samples.empty() && samples[0].start < start)
+        samples[0].start = start;
+
+    TraceIndex traceIndex;
+    if(indexName && !traceIndex.load(indexName))
+    {
+        fprintf(stderr, "Error opening index %s\n", indexName);
+        return 1;
+    }
+    const TraceIndex *index = indexName ? &traceIndex : NULL;
+
+    if(threads > 0)
+    {
+        if(!traceName || restoreName || saveName || simpointsName || start > 1)
+        {
+            fprintf(stderr, "Error: --parallel needs a named trace file and no snapshots, simpoints or --start\n");
+            return 1;
+        }
+        fclose(inputFile);
+
+        uint64_t total = index ? index->microops : countMicroOps(traceName);
+        if(threads > total)
+            threads = total > 0 ? total : 1;
+        vector<vector<Simulator*> > parts(threads);
+        for(unsigned t = 0; t < threads; t++)
+        {
+            SamplePoint sample = { total * t / threads + 1, total * (t + 1) / threads + 1, 1, 0, 0, 0, 0 };
+            for(size_t i = 0; i < types.size(); i++)
+            {
+                parts[t].push_back(new Simulator);
+                parts[t][i]->reset(types[i], sizes[i], stdout);
+                parts[t][i]->setSamples(vector<SamplePoint>(1, sample), warmup);
+            }
+        }
+
+        vector<thread> workers;
+        for(unsigned t = 0; t < threads; t++)
+            workers.push_back(thread(simulateInterval, traceName, index, &parts[t]));
+        for(unsigned t = 0; t < threads; t++)
+            workers[t].join();
+
+        for(size_t i = 0; i < types.size(); i++)
+        {
+            char label[64] = "";
+            if(types.size() > 1)
+                snprintf(label, sizeof(label), "%s %d: ", types[i]->name, sizes[i]);
+            vector<Simulator*> config;
+            for(unsigned t = 0; t < threads; t++)
+                config.push_back(parts[t][i]);
+            printStitchedResult(stdout, label, config);
+            for(unsigned t = 0; t < threads; t++)
+                delete parts[t][i];
+        }
+        return 0;
+    }
+
+    TraceReader trace;
+    trace.open(inputFile);
+
+    vector<Simulator*> sims;
+    for(size_t i = 0; i < types.size(); i++)
+    {
+        sims.push_back(new Simulator);
+        sims[i]->reset(types[i], sizes[i], stdout);
+        sims[i]->setSamples(samples, warmup);
+    }
+
+    TraceWindow window;
+    if(restoreName)
+    {
+        FILE *file = fopen(restoreName, "rb");
+        if(file == NULL)
+        {
+            fprintf(stderr, "Error opening snapshot %s\n", restoreName);
+            return 1;
+        }
+        Snapshot s = { file, true };
+        serializeRun(s, trace, window, sims);
+        fclose(file);
+
+        for(size_t i = 0; i < sims.size(); i++)
+        {
+            if(forwardGiven)
+                sims[i]->setForwardLatency(forwardLatency);
+            if(recoveryGiven)
+                sims[i]->selectiveRecovery = selectiveRecovery;
+        }
+    }
+    else if(start > 1)
+        startAt(trace, index, start, window, sims);
+
+    uint64_t nextSave = saveEvery;
+    do
+    {
+        window.refill(trace);
+        for(size_t i = 0; i < sims.size(); i++)
+            sims[i]->simulate(window);
+
+        uint64_t decoded = window.endAge - 1;
+        if(saveName && !window.last && saveAt && decoded >= saveAt)
+        {
+            saveSnapshot(saveName, trace, window, sims);
+            fprintf(stderr, "Saved snapshot after %" PRIu64 " micro-ops\n", decoded);
+            return 0;
+        }
+        if(saveName && !window.last && saveEvery && decoded >= nextSave)
+        {
+            saveSnapshot(saveName, trace, window, sims);
+            nextSave = decoded + saveEvery;
+        }
+    } while(!window.last);
+
+    for(size_t i = 0; i < sims.size(); i++)
+    {
+        char label[64] = "";
+        if(sims.size() > 1)
+            snprintf(label, sizeof(label), "%s %u: ", sims[i]->type->name, sims[i]->rob.maxMicroOps);
+        sims[i]->printResult(label);
+        delete sims[i];
+    }
+    return 0;
+}
+
+#endif
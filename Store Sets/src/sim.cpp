@@ -0,0 +1,8 @@
+#include "pipeline.h"
+
+// All the predictors in one binary, chosen with --predictor=<name> or per configuration
+// (e.g. ./sim ss2:128,perfect:128); see Readme.
+int main(int argc, char *argv[])
+{
+    return simMain(argc, argv, NULL);
+}
@@ -0,0 +1,209 @@
+#include <cinttypes>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "trace.h"
+
+using namespace std;
+
+// Picks representative intervals of a trace, SimPoint style: the trace is cut into
+// fixed-size intervals of micro-ops, each interval is summarised by its basic block
+// vector (how many micro-ops each basic block contributed), and k-means over those
+// vectors picks one interval per cluster, weighted by the cluster's share of the trace.
+//     ./simpoint 10000000 10 gcc-50M.trace.gz > gcc-50M.simpoints
+//     ./ss2 128 gcc-50M.trace.gz --simpoints=gcc-50M.simpoints
+// The vectors are randomly projected down to DIMENSIONS, as SimPoint does.
+
+const int DIMENSIONS = 15;
+const int SEEDS = 5;
+const int ITERATIONS = 100;
+
+uint64_t mix(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// A fixed random projection coefficient in [-1, 1] for a block and dimension.
+double projection(uint64_t blockPC, int dimension)
+{
+    return double(mix(blockPC * DIMENSIONS + dimension) >> 11) / double(1ULL << 52) - 1;
+}
+
+double distance(const double *a, const double *b)
+{
+    double d = 0;
+    for(int i = 0; i < DIMENSIONS; i++)
+        d += (a[i] - b[i]) * (a[i] - b[i]);
+    return d;
+}
+
+// k-means++ seeding followed by Lloyd iterations. Returns the sum of squared distances.
+double kmeans(const vector<double> &points, size_t n, int k, uint64_t seed, vector<double> &centres, vector<int> &cluster)
+{
+    centres.assign(k * DIMENSIONS, 0);
+    cluster.assign(n, 0);
+    vector<double> nearest(n, 1e300);
+
+    size_t first = mix(seed) % n;
+    memcpy(&centres[0], &points[first * DIMENSIONS], sizeof(double) * DIMENSIONS);
+    for(int c = 1; c < k; c++)
+    {
+        double total = 0;
+        for(size_t i = 0; i < n; i++)
+        {
+            double d = distance(&points[i * DIMENSIONS], &centres[(c - 1) * DIMENSIONS]);
+            if(d < nearest[i])
+                nearest[i] = d;
+            total += nearest[i];
+        }
+        double r = double(mix(seed + c) >> 11) / double(1ULL << 53) * total;
+        size_t pick = 0;
+        while(pick + 1 < n && (r -= nearest[pick]) > 0)
+            pick++;
+        memcpy(&centres[c * DIMENSIONS], &points[pick * DIMENSIONS], sizeof(double) * DIMENSIONS);
+    }
+
+    double sse = 0;
+    for(int iteration = 0; iteration < ITERATIONS; iteration++)
+    {
+        bool changed = false;
+        sse = 0;
+        for(size_t i = 0; i < n; i++)
+        {
+            int best = 0;
+            double bestDistance = 1e300;
+            for(int c = 0; c < k; c++)
+            {
+                double d = distance(&points[i * DIMENSIONS], &centres[c * DIMENSIONS]);
+                if(d < bestDistance)
+                    bestDistance = d, best = c;
+            }
+            if(cluster[i] != best)
+                changed = true;
+            cluster[i] = best;
+            sse += bestDistance;
+        }
+        if(!changed && iteration > 0)
+            break;
+
+        vector<int> count(k, 0);
+        vector<double> sum(k * DIMENSIONS, 0);
+        for(size_t i = 0; i < n; i++)
+        {
+            count[cluster[i]]++;
+            for(int j = 0; j < DIMENSIONS; j++)
+                sum[cluster[i] * DIMENSIONS + j] += points[i * DIMENSIONS + j];
+        }
+        for(int c = 0; c < k; c++)
+            if(count[c] > 0)
+                for(int j = 0; j < DIMENSIONS; j++)
+                    centres[c * DIMENSIONS + j] = sum[c * DIMENSIONS + j] / count[c];
+    }
+    return sse;
+}
+
+int main(int argc, char *argv[])
+{
+    // clusters has to be a whole positive number, so a trace named in its place is not read as 0
+    char *end = NULL;
+    long clusters = argc >= 3 ? strtol(argv[2], &end, 10) : 10;
+    if(argc < 2 || strtoull(argv[1], NULL, 10) == 0 || (argc >= 3 && (end == argv[2] || *end != '\0')) ||
+       clusters < 1 || clusters > INT_MAX)
+    {
+        fprintf(stderr, "Usage: %s <interval micro-ops> [clusters] [trace file]\n", argv[0]);
+        return 1;
+    }
+    uint64_t interval = strtoull(argv[1], NULL, 10);
+    int k = clusters;
+
+    FILE *inputFile = stdin;
+    if(argc >= 4 && (inputFile = fopen(argv[3], "rb")) == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", argv[3]);
+        return 1;
+    }
+
+    TraceReader trace;
+    trace.open(inputFile);
+
+    // One projected, per-micro-op normalised basic block vector per interval. A block
+    // starts after any micro-op that ends one (a branch) and is named by its first PC.
+    vector<double> points;
+    vector<uint64_t> lengths;
+    double bbv[DIMENSIONS] = {0};
+    uint64_t blockPC = 0, blockLength = 0, intervalLength = 0, totalMicroops = 0;
+    TraceRecord r;
+    bool more = trace.next(r);
+    while(more)
+    {
+        if(blockLength == 0)
+            blockPC = r.instructionAddress;
+        blockLength++;
+        intervalLength++;
+        totalMicroops++;
+        bool endOfBlock = r.TNnotBranch != '-';
+        more = trace.next(r);
+
+        if(endOfBlock || intervalLength == interval || !more)
+        {
+            for(int j = 0; j < DIMENSIONS; j++)
+                bbv[j] += projection(blockPC, j) * blockLength;
+            blockLength = 0;
+        }
+        if(intervalLength == interval || (!more && intervalLength > 0))
+        {
+            for(int j = 0; j < DIMENSIONS; j++)
+                points.push_back(bbv[j] / intervalLength), bbv[j] = 0;
+            lengths.push_back(intervalLength);
+            intervalLength = 0;
+        }
+    }
+
+    size_t n = lengths.size();
+    if(n == 0)
+    {
+        fprintf(stderr, "Error: empty trace\n");
+        return 1;
+    }
+    if(size_t(k) > n)
+        k = n;
+
+    vector<double> centres, bestCentres;
+    vector<int> cluster, bestCluster;
+    double bestSSE = 1e300;
+    for(int seed = 0; seed < SEEDS; seed++)
+    {
+        double sse = kmeans(points, n, k, seed, centres, cluster);
+        if(sse < bestSSE)
+            bestSSE = sse, bestCentres = centres, bestCluster = cluster;
+    }
+
+    // For each cluster, the interval nearest its centre stands for all of it.
+    printf("# interval %" PRIu64 "\n", interval);
+    for(int c = 0; c < k; c++)
+    {
+        size_t pick = n;
+        double pickDistance = 1e300;
+        uint64_t microops = 0;
+        for(size_t i = 0; i < n; i++)
+            if(bestCluster[i] == c)
+            {
+                microops += lengths[i];
+                double d = distance(&points[i * DIMENSIONS], &bestCentres[c * DIMENSIONS]);
+                if(d < pickDistance)
+                    pickDistance = d, pick = i;
+            }
+        if(pick < n)
+            printf("%zu %f\n", pick, double(microops) / totalMicroops);
+    }
+
+    fprintf(stderr, "%zu intervals, %d clusters, %" PRIu64 " micro-ops\n", n, k, totalMicroops);
+    return 0;
+}
@@ -0,0 +1,7 @@
+#include "pipeline.h"
+
+// See Readme; the pipeline itself is in pipeline.h.
+int main(int argc, char *argv[])
+{
+    return simMain(argc, argv, "sst");
+}
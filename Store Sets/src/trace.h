@@ -0,0 +1,1127 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <zlib.h>
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+// One line of the CIS501 trace. See the documentation to understand what these fields mean.
+// The operation strings are not NUL terminated; they point into the reader's input
+// (the mapped file, its read buffer or its string table) and stay valid until the
+// next call to TraceReader::next.
+struct TraceRecord
+{
+    int32_t microOpCount;
+    uint64_t instructionAddress;
+    int32_t sourceRegister1;
+    int32_t sourceRegister2;
+    int32_t destinationRegister;
+    char conditionRegister;
+    char TNnotBranch;
+    char loadStore;
+    int64_t immediate;
+    uint64_t addressForMemoryOp;
+    uint64_t fallthroughPC;
+    uint64_t targetAddressTakenBranch;
+    const char *macroOperation;
+    const char *microOperation;
+    uint8_t macroLength;
+    uint8_t microLength;
+};
+
+// Binary trace format (written by traceconv):
+//
+//   header : 0x89 'S' 'S' 'T' version
+//   record : flags, conditionRegister, TNnotBranch, loadStore, then varints for
+//            microOpCount, sourceRegister1, sourceRegister2, destinationRegister,
+//            instructionAddress (delta from previous PC), fallthroughPC (delta from PC),
+//            targetAddressTakenBranch (delta from PC, if TRACE_HAS_TARGET),
+//            immediate (if TRACE_HAS_IMM), addressForMemoryOp (delta from previous
+//            address, if TRACE_HAS_ADDR), macro and micro operation string ids.
+//
+// Signed values are zigzag encoded. The operation strings are interned: the first
+// record to use a string carries it inline (length byte + chars) and sets
+// TRACE_NEW_MACRO / TRACE_NEW_MICRO, later records only carry the id.
+const uint8_t TRACE_MAGIC[4] = { 0x89, 'S', 'S', 'T' };
+const uint8_t TRACE_VERSION = 1;
+
+const uint8_t TRACE_NEW_MACRO = 0x01;
+const uint8_t TRACE_NEW_MICRO = 0x02;
+const uint8_t TRACE_HAS_ADDR = 0x04;
+const uint8_t TRACE_HAS_TARGET = 0x08;
+const uint8_t TRACE_HAS_IMM = 0x10;
+
+// Longest possible encoded record: 4 bytes, 9 varints of up to 10 bytes, 2 inline strings.
+const int TRACE_MAX_RECORD = 4 + 9 * 10 + 2 * (10 + 1 + 22);
+const size_t TRACE_BUFFER = 1 << 16;
+const size_t TRACE_PADDING = TRACE_MAX_RECORD;
+
+// Decompressed traces are handed over in blocks of TRACE_BLOCK bytes, each with
+// TRACE_BUFFER bytes of headroom in front so a record split across two blocks can be
+// completed by copying the (short) unread tail of the old block in front of the new one.
+const size_t TRACE_BLOCK = 1 << 20;
+const int TRACE_BLOCKS = 4;
+
+inline uint64_t zigzag(int64_t v)
+{
+    return (uint64_t(v) << 1) ^ uint64_t(v >> 63);
+}
+
+inline int64_t unzigzag(uint64_t v)
+{
+    return int64_t(v >> 1) ^ -int64_t(v & 1);
+}
+
+inline uint8_t* putVarint(uint8_t *p, uint64_t v)
+{
+    while(v >= 0x80)
+    {
+        *p++ = uint8_t(v) | 0x80;
+        v >>= 7;
+    }
+    *p++ = uint8_t(v);
+    return p;
+}
+
+inline const uint8_t* getVarint(const uint8_t *p, uint64_t &v)
+{
+    v = 0;
+    for(int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t b = *p++;
+        v |= uint64_t(b & 0x7F) << shift;
+        if(!(b & 0x80))
+            break;
+    }
+    return p;
+}
+
+// A checkpoint file. Each structure has one serialize() routine that either writes
+// its state here or reads it back, depending on reading.
+const char SNAPSHOT_MAGIC[8] = { 'S', 'S', 'S', 'N', 'A', 'P', '0', '1' };
+
+struct Snapshot
+{
+    FILE *file;
+    bool reading;
+
+    template<class T> void io(T &v)
+    {
+        if(reading ? fread(&v, sizeof(T), 1, file) != 1 : fwrite(&v, sizeof(T), 1, file) != 1)
+        {
+            fprintf(stderr, "Error %s snapshot", reading ? "reading" : "writing");
+            abort();
+        }
+    }
+
+    // element count of a container; on read the caller resizes to it
+    size_t ioSize(size_t n)
+    {
+        uint64_t v = n;
+        io(v);
+        return v;
+    }
+
+    void io(string &v)
+    {
+        size_t n = ioSize(v.size());
+        v.resize(n);
+        for(size_t i = 0; i < n; i++)
+            io(v[i]);
+    }
+
+    template<class T> void io(vector<T> &v)
+    {
+        v.resize(ioSize(v.size()));
+        for(size_t i = 0; i < v.size(); i++)
+            io(v[i]);
+    }
+
+    template<class T> void io(deque<T> &v)
+    {
+        v.resize(ioSize(v.size()));
+        for(size_t i = 0; i < v.size(); i++)
+            io(v[i]);
+    }
+
+    template<class T> void io(set<T> &v)
+    {
+        size_t n = ioSize(v.size());
+        if(!reading)
+        {
+            for(typename set<T>::iterator itr = v.begin(); itr != v.end(); itr++)
+            {
+                T e = *itr;
+                io(e);
+            }
+            return;
+        }
+        v.clear();
+        for(size_t i = 0; i < n; i++)
+        {
+            T e;
+            io(e);
+            v.insert(v.end(), e);
+        }
+    }
+
+    template<class K, class T> void io(map<K, T> &v)
+    {
+        size_t n = ioSize(v.size());
+        if(!reading)
+        {
+            for(typename map<K, T>::iterator itr = v.begin(); itr != v.end(); itr++)
+            {
+                K k = itr->first;
+                io(k);
+                io(itr->second);
+            }
+            return;
+        }
+        v.clear();
+        for(size_t i = 0; i < n; i++)
+        {
+            K k;
+            io(k);
+            io(v[k]);
+        }
+    }
+};
+
+struct TraceWriter
+{
+    FILE *file;
+    uint64_t lastPC;
+    uint64_t lastAddress;
+    unordered_map<string, uint32_t> macroTable, microTable;  // string -> its index
+    string key;                                               // reused, so a lookup does not allocate
+
+    void open(FILE *outputFile)
+    {
+        file = outputFile;
+        lastPC = lastAddress = 0;
+        macroTable.clear();
+        microTable.clear();
+        fwrite(TRACE_MAGIC, 1, 4, file);
+        fputc(TRACE_VERSION, file);
+    }
+
+    uint8_t* putString(uint8_t *p, unordered_map<string, uint32_t> &table, const char *s, uint8_t len, uint8_t newFlag, uint8_t &flags)
+    {
+        key.assign(s, len);
+        unordered_map<string, uint32_t>::iterator itr = table.find(key);
+        if(itr != table.end())
+            return putVarint(p, itr->second);
+
+        flags |= newFlag;
+        uint32_t id = table.size();
+        p = putVarint(p, id);
+        table[key] = id;
+        *p++ = len;
+        memcpy(p, s, len);
+        return p + len;
+    }
+
+    void write(const TraceRecord &r)
+    {
+        uint8_t buf[TRACE_MAX_RECORD];
+        uint8_t flags = 0;
+        uint8_t *p = buf + 4;
+
+        p = putVarint(p, zigzag(r.microOpCount));
+        p = putVarint(p, zigzag(r.sourceRegister1));
+        p = putVarint(p, zigzag(r.sourceRegister2));
+        p = putVarint(p, zigzag(r.destinationRegister));
+        p = putVarint(p, zigzag(int64_t(r.instructionAddress - lastPC)));
+        p = putVarint(p, zigzag(int64_t(r.fallthroughPC - r.instructionAddress)));
+        if(r.targetAddressTakenBranch != 0)
+        {
+            flags |= TRACE_HAS_TARGET;
+            p = putVarint(p, zigzag(int64_t(r.targetAddressTakenBranch - r.instructionAddress)));
+        }
+        if(r.immediate != 0)
+        {
+            flags |= TRACE_HAS_IMM;
+            p = putVarint(p, zigzag(r.immediate));
+        }
+        if(r.addressForMemoryOp != 0)
+        {
+            flags |= TRACE_HAS_ADDR;
+            p = putVarint(p, zigzag(int64_t(r.addressForMemoryOp - lastAddress)));
+            lastAddress = r.addressForMemoryOp;
+        }
+        p = putString(p, macroTable, r.macroOperation, r.macroLength, TRACE_NEW_MACRO, flags);
+        p = putString(p, microTable, r.microOperation, r.microLength, TRACE_NEW_MICRO, flags);
+        lastPC = r.instructionAddress;
+
+        buf[0] = flags;
+        buf[1] = r.conditionRegister;
+        buf[2] = r.TNnotBranch;
+        buf[3] = r.loadStore;
+        fwrite(buf, 1, p - buf, file);
+    }
+};
+
+// Hand-written replacements for the "%i", "%x", " %c" and "%s" conversions of the
+// old fscanf format. They scan a single line that is known to end in '\n', so the
+// newline doubles as the sentinel and none of them needs a bounds check.
+inline const char* skipSpace(const char *p)
+{
+    while(*p == ' ' || *p == '\t' || *p == '\r')
+        p++;
+    return p;
+}
+
+inline int digitValue(char c)
+{
+    if(c >= '0' && c <= '9')
+        return c - '0';
+    c |= 0x20;
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    return 99;
+}
+
+inline const char* parseDigits(const char *p, int base, uint64_t &v)
+{
+    const char *start = p;
+    int d;
+    v = 0;
+    while((d = digitValue(*p)) < base)
+    {
+        v = v * base + d;
+        p++;
+    }
+    return p == start ? NULL : p;
+}
+
+inline const char* parseHex(const char *p, uint64_t &v)
+{
+    p = skipSpace(p);
+    if(p[0] == '0' && (p[1] | 0x20) == 'x' && digitValue(p[2]) < 16)
+        p += 2;
+    return parseDigits(p, 16, v);
+}
+
+inline const char* parseInt(const char *p, int64_t &v)
+{
+    p = skipSpace(p);
+    bool negative = *p == '-';
+    if(*p == '-' || *p == '+')
+        p++;
+
+    uint64_t u;
+    if(p[0] == '0' && (p[1] | 0x20) == 'x' && digitValue(p[2]) < 16)
+        p = parseDigits(p + 2, 16, u);
+    else
+        p = parseDigits(p, p[0] == '0' ? 8 : 10, u);
+    v = negative ? -int64_t(u) : int64_t(u);
+    return p;
+}
+
+inline const char* parseInt32(const char *p, int32_t &v)
+{
+    int64_t w;
+    p = parseInt(p, w);
+    v = int32_t(w);
+    return p;
+}
+
+inline const char* parseChar(const char *p, char &c)
+{
+    p = skipSpace(p);
+    if(*p == '\n')
+        return NULL;
+    c = *p;
+    return p + 1;
+}
+
+inline const char* parseString(const char *p, const char *&s, uint8_t &len, size_t maxLen)
+{
+    p = skipSpace(p);
+    s = p;
+    while(*p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+        p++;
+    if(p == s || size_t(p - s) > maxLen)
+        return NULL;
+    len = uint8_t(p - s);
+    return p;
+}
+
+// Parses one text record from a line ending in '\n'. Returns NULL on a malformed line.
+inline const char* parseTextRecord(const char *p, TraceRecord &r)
+{
+    if(p) p = parseInt32(p, r.microOpCount);
+    if(p) p = parseHex(p, r.instructionAddress);
+    if(p) p = parseInt32(p, r.sourceRegister1);
+    if(p) p = parseInt32(p, r.sourceRegister2);
+    if(p) p = parseInt32(p, r.destinationRegister);
+    if(p) p = parseChar(p, r.conditionRegister);
+    if(p) p = parseChar(p, r.TNnotBranch);
+    if(p) p = parseChar(p, r.loadStore);
+    if(p) p = parseInt(p, r.immediate);
+    if(p) p = parseHex(p, r.addressForMemoryOp);
+    if(p) p = parseHex(p, r.fallthroughPC);
+    if(p) p = parseHex(p, r.targetAddressTakenBranch);
+    if(p) p = parseString(p, r.macroOperation, r.macroLength, 11);
+    if(p) p = parseString(p, r.microOperation, r.microLength, 22);
+    if(p) p = skipSpace(p);
+    return p && *p == '\n' ? p : NULL;
+}
+
+struct TraceBlock
+{
+    vector<char> data;
+    size_t size;
+
+    char* begin()
+    {
+        return &data[TRACE_BUFFER];
+    }
+};
+
+// A place the decompressor can restart from: compressed offset in, decompressed
+// offset out. Inside a deflate stream it starts bits into the byte before in and
+// needs the 32K of output before it as the dictionary; bits is -1 at the start of
+// a gzip member or zstd frame, where nothing earlier is needed.
+struct TracePoint
+{
+    uint64_t in, out;
+    int32_t bits;
+    string window;
+};
+
+const uint64_t TRACE_POINT_SPAN = 1 << 22;
+
+// Decompresses a .gz (or, built with -DUSE_ZSTD, a .zst) trace on its own thread into
+// a small pool of blocks, so inflating overlaps with simulation instead of running in
+// a separate zcat process and going through a pipe. With indexing on it also records
+// a restart point about every TRACE_POINT_SPAN decompressed bytes.
+struct TraceDecompressor
+{
+    int fd;
+    bool zstd;
+    bool raw;
+    bool memberEnd, inputEnd;
+    uint64_t memberEndOut;
+    bool indexing;
+    uint64_t inOffset, outOffset;
+    vector<uint8_t> input;
+    z_stream inflater;
+#ifdef USE_ZSTD
+    ZSTD_DStream *zs;
+    ZSTD_inBuffer zin;
+#endif
+    vector<TracePoint> points;
+
+    vector<TraceBlock> blocks;
+    deque<TraceBlock*> freeBlocks, fullBlocks;
+    bool finished, stopping;
+    mutex lock;
+    condition_variable changed;
+    thread worker;
+
+    void start(int inputFd, bool isZstd, const TracePoint &from, bool isIndexing)
+    {
+        fd = inputFd;
+        zstd = isZstd;
+        indexing = isIndexing;
+        inOffset = from.in;
+        outOffset = from.out;
+        memberEnd = inputEnd = false;
+        input.resize(1 << 18);
+        points.clear();
+        if(indexing)
+            points.push_back(from);
+
+        if(zstd)
+        {
+#ifdef USE_ZSTD
+            zs = ZSTD_createDStream();
+            ZSTD_initDStream(zs);
+            zin.src = &input[0];
+            zin.size = zin.pos = 0;
+#else
+            fprintf(stderr, "Error opening trace: rebuild with -DUSE_ZSTD -lzstd to read .zst traces\n");
+            abort();
+#endif
+        }
+        else
+        {
+            memset(&inflater, 0, sizeof(inflater));
+            raw = from.bits >= 0;
+            if(inflateInit2(&inflater, raw ? -15 : 47) != Z_OK)
+            {
+                fprintf(stderr, "Error decompressing trace");
+                abort();
+            }
+            if(raw)
+            {
+                // resume mid-stream: the partial byte before in, then the dictionary
+                if(from.bits > 0)
+                {
+                    uint8_t partial;
+                    if(pread(fd, &partial, 1, from.in - 1) != 1)
+                    {
+                        fprintf(stderr, "Error decompressing trace");
+                        abort();
+                    }
+                    inflatePrime(&inflater, from.bits, partial >> (8 - from.bits));
+                }
+                inflateSetDictionary(&inflater, (const Bytef*)from.window.data(), from.window.size());
+            }
+        }
+
+        blocks.resize(TRACE_BLOCKS);
+        for(int i = 0; i < TRACE_BLOCKS; i++)
+        {
+            blocks[i].data.resize(TRACE_BUFFER + TRACE_BLOCK);
+            freeBlocks.push_back(&blocks[i]);
+        }
+        finished = stopping = false;
+        worker = thread(&TraceDecompressor::run, this);
+    }
+
+    ~TraceDecompressor()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        if(worker.joinable())
+            worker.join();
+        if(!zstd)
+            inflateEnd(&inflater);
+#ifdef USE_ZSTD
+        else
+            ZSTD_freeDStream(zs);
+#endif
+    }
+
+    // Reads more compressed input at inOffset; false at the end of the file.
+    size_t readInput()
+    {
+        ssize_t n = pread(fd, &input[0], input.size(), inOffset);
+        if(n < 0)
+        {
+            fprintf(stderr, "Error reading trace");
+            abort();
+        }
+        inOffset += n;
+        return n;
+    }
+
+    size_t inflateBlock(char *dst, size_t cap)
+    {
+        inflater.next_out = (Bytef*)dst;
+        inflater.avail_out = cap;
+        while(inflater.avail_out > 0 && !inputEnd)
+        {
+            if(inflater.avail_in == 0)
+            {
+                inflater.avail_in = readInput();
+                inflater.next_in = &input[0];
+                if(inflater.avail_in == 0)
+                    break;
+            }
+
+            int ret = inflate(&inflater, indexing ? Z_BLOCK : Z_NO_FLUSH);
+            uint64_t out = outOffset + (cap - inflater.avail_out);
+            if(ret == Z_STREAM_END)
+            {
+                // another gzip member may follow; a raw stream still has its 8 byte trailer
+                inOffset -= inflater.avail_in;
+                if(raw)
+                    inOffset += 8;
+                inflater.avail_in = 0;
+                raw = false;
+                memberEnd = true;
+                memberEndOut = out;
+                inflateReset2(&inflater, 47);
+                continue;
+            }
+            if(ret == Z_DATA_ERROR && memberEnd && out == memberEndOut)
+            {
+                // padding after the last member, as gzip itself allows
+                inputEnd = true;
+                break;
+            }
+            if(ret != Z_OK && ret != Z_BUF_ERROR)
+            {
+                fprintf(stderr, "Error decompressing trace");
+                abort();
+            }
+
+            if(indexing && (inflater.data_type & 128) && !(inflater.data_type & 64) && out - points.back().out >= TRACE_POINT_SPAN)
+            {
+                TracePoint point;
+                point.in = inOffset - inflater.avail_in;
+                point.out = out;
+                point.bits = inflater.data_type & 7;
+                point.window.resize(32768);
+                uInt length = 32768;
+                inflateGetDictionary(&inflater, (Bytef*)&point.window[0], &length);
+                point.window.resize(length);
+                lock_guard<mutex> guard(lock);
+                points.push_back(point);
+            }
+        }
+        return cap - inflater.avail_out;
+    }
+
+    size_t readBlock(char *dst, size_t cap)
+    {
+        if(!zstd)
+            return inflateBlock(dst, cap);
+
+        size_t total = 0;
+#ifdef USE_ZSTD
+        while(total < cap)
+        {
+            if(zin.pos == zin.size)
+            {
+                zin.size = readInput();
+                zin.pos = 0;
+                if(zin.size == 0)
+                    break;
+            }
+            ZSTD_outBuffer out = { dst, cap, total };
+            size_t ret = ZSTD_decompressStream(zs, &out, &zin);
+            if(ZSTD_isError(ret))
+            {
+                fprintf(stderr, "Error decompressing trace");
+                abort();
+            }
+            total = out.pos;
+
+            // a finished frame is a restart point that needs no history
+            if(ret == 0 && indexing && outOffset + total - points.back().out >= TRACE_POINT_SPAN)
+            {
+                TracePoint point;
+                point.in = inOffset - (zin.size - zin.pos);
+                point.out = outOffset + total;
+                point.bits = -1;
+                lock_guard<mutex> guard(lock);
+                points.push_back(point);
+            }
+        }
+#endif
+        return total;
+    }
+
+    void run()
+    {
+        while(true)
+        {
+            TraceBlock *b;
+            {
+                unique_lock<mutex> guard(lock);
+                while(freeBlocks.empty() && !stopping)
+                    changed.wait(guard);
+                if(stopping)
+                    return;
+                b = freeBlocks.front();
+                freeBlocks.pop_front();
+            }
+
+            b->size = readBlock(b->begin(), TRACE_BLOCK);
+            outOffset += b->size;
+
+            {
+                lock_guard<mutex> guard(lock);
+                if(b->size == 0)
+                {
+                    freeBlocks.push_back(b);
+                    finished = true;
+                }
+                else
+                    fullBlocks.push_back(b);
+            }
+            changed.notify_all();
+            if(b->size == 0)
+                return;
+        }
+    }
+
+    // Next decompressed block in order, or NULL at the end of the trace.
+    TraceBlock* take()
+    {
+        unique_lock<mutex> guard(lock);
+        while(fullBlocks.empty() && !finished)
+            changed.wait(guard);
+        if(fullBlocks.empty())
+            return NULL;
+        TraceBlock *b = fullBlocks.front();
+        fullBlocks.pop_front();
+        return b;
+    }
+
+    void release(TraceBlock *b)
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            freeBlocks.push_back(b);
+        }
+        changed.notify_all();
+    }
+};
+
+// Where every interval-th micro-op starts in a trace and the decoder state there, so
+// a reader can start at any age without decoding everything before it. Built by
+// traceindex; the string tables are the final ones, each entry uses a prefix.
+struct TraceIndexEntry
+{
+    uint64_t age;
+    uint64_t offset;          // in the decompressed input
+    uint64_t lastPC;
+    uint64_t lastAddress;
+    uint32_t macroCount, microCount;
+    uint32_t point;
+};
+
+const char TRACE_INDEX_MAGIC[] = "SSTIDX01";
+
+struct TraceIndex
+{
+    uint64_t interval;
+    uint64_t fileSize;
+    uint64_t microops;
+    bool binary;
+    vector<TracePoint> points;
+    vector<TraceIndexEntry> entries;
+    vector<string> macroTable, microTable;
+
+    void serialize(Snapshot &s)
+    {
+        char magic[8];
+        memcpy(magic, TRACE_INDEX_MAGIC, 8);
+        s.io(magic);
+        if(memcmp(magic, TRACE_INDEX_MAGIC, 8) != 0)
+        {
+            fprintf(stderr, "Error reading trace index: not an index file");
+            abort();
+        }
+        s.io(interval);
+        s.io(fileSize);
+        s.io(microops);
+        s.io(binary);
+        points.resize(s.ioSize(points.size()));
+        for(size_t i = 0; i < points.size(); i++)
+        {
+            s.io(points[i].in);
+            s.io(points[i].out);
+            s.io(points[i].bits);
+            s.io(points[i].window);
+        }
+        s.io(entries);
+        s.io(macroTable);
+        s.io(microTable);
+    }
+
+    bool load(const char *name)
+    {
+        FILE *file = fopen(name, "rb");
+        if(file == NULL)
+            return false;
+        Snapshot s = { file, true };
+        serialize(s);
+        fclose(file);
+        return true;
+    }
+
+    // The last entry at or before age.
+    const TraceIndexEntry& find(uint64_t age) const
+    {
+        size_t low = 0, high = entries.size();
+        while(high - low > 1)
+        {
+            size_t mid = (low + high) / 2;
+            if(entries[mid].age <= age)
+                low = mid;
+            else
+                high = mid;
+        }
+        return entries[low];
+    }
+};
+
+struct TraceReader
+{
+    FILE *file;
+    bool binary;
+
+    // Undecoded input. A regular file is mapped and decoded in place, a compressed
+    // one is decoded in place from the decompressor's blocks. A pipe, or the last few
+    // bytes of the input, is read into buf, which is padded so a truncated record
+    // cannot run past it.
+    const char *cur, *limit;
+    uint64_t limitOffset;     // position of limit in the (decompressed) input
+    bool inputEnd;
+    char *mapping;
+    size_t mappingSize;
+    TraceDecompressor *decompressor;
+    TraceBlock *block;
+    vector<char> buf;
+
+    uint64_t lastPC;
+    uint64_t lastAddress;
+    vector<string> macroTable, microTable;
+
+    TraceReader()
+    {
+        mapping = NULL;
+        decompressor = NULL;
+        block = NULL;
+    }
+
+    ~TraceReader()
+    {
+        if(mapping)
+            munmap(mapping, mappingSize);
+        delete decompressor;
+    }
+
+    // Detects gzip/zstd compression from the file's magic number and the trace format
+    // from the first decompressed byte: text traces start with a digit. indexing makes
+    // the decompressor record restart points for traceindex.
+    void open(FILE *inputFile, bool indexing = false)
+    {
+        file = inputFile;
+        buf.assign(TRACE_BUFFER + TRACE_PADDING, 0);
+        cur = limit = &buf[0];
+        limitOffset = 0;
+        inputEnd = false;
+        lastPC = lastAddress = 0;
+        macroTable.clear();
+        microTable.clear();
+
+        struct stat st;
+        int fd = fileno(file);
+        off_t offset = lseek(fd, 0, SEEK_CUR);
+        bool regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && offset >= 0 && st.st_size > offset;
+        uint8_t magic[4] = { 0, 0, 0, 0 };
+        if(regular && pread(fd, magic, 4, offset) < 4)
+            regular = false;
+
+        if((magic[0] == 0x1f && magic[1] == 0x8b) || (magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd))
+        {
+            TracePoint start = { uint64_t(offset), 0, -1, "" };
+            decompressor = new TraceDecompressor;
+            decompressor->start(fd, magic[0] == 0x28, start, indexing);
+        }
+        else if(regular)
+        {
+            void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if(m != MAP_FAILED)
+            {
+                mapping = (char*)m;
+                mappingSize = st.st_size;
+                madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+                cur = mapping + offset;
+                limit = mapping + mappingSize;
+                limitOffset = mappingSize;
+            }
+        }
+
+        ensure(5);
+        binary = cur < limit && uint8_t(*cur) == TRACE_MAGIC[0];
+        if(!binary)
+            return;
+
+        if(limit - cur < 5 || memcmp(cur, TRACE_MAGIC, 4) != 0 || uint8_t(cur[4]) != TRACE_VERSION)
+        {
+            fprintf(stderr, "Error parsing trace header");
+            abort();
+        }
+        cur += 5;
+    }
+
+    // Makes sure the window holds at least need bytes, or everything left in the input.
+    void ensure(size_t need)
+    {
+        if(size_t(limit - cur) >= need || inputEnd)
+            return;
+
+        if(decompressor)
+        {
+            while(size_t(limit - cur) < need)
+            {
+                // copy the unread tail in front of the next block before handing back the old one
+                TraceBlock *next = decompressor->take();
+                if(!next)
+                    break;
+                size_t n = limit - cur;
+                char *start = next->begin() - n;
+                memmove(start, cur, n);
+                if(block)
+                    decompressor->release(block);
+                block = next;
+                cur = start;
+                limit = next->begin() + next->size;
+                limitOffset += next->size;
+            }
+            if(size_t(limit - cur) >= need)
+                return;
+        }
+
+        size_t n = limit - cur;
+        memmove(&buf[0], cur, n);
+        if(mapping || decompressor)
+            inputEnd = true;
+        else
+        {
+            size_t got = fread(&buf[n], 1, TRACE_BUFFER - n, file);
+            n += got;
+            limitOffset += got;
+            inputEnd = feof(file) || ferror(file);
+        }
+        memset(&buf[n], 0, TRACE_PADDING);
+        cur = &buf[0];
+        limit = cur + n;
+    }
+
+    // Position of the next record in the (decompressed) input.
+    uint64_t tell()
+    {
+        return limitOffset - (limit - cur);
+    }
+
+    // Skips forward to a position returned by tell(). Mapped input just moves the
+    // window; anything else has to be read (and decompressed) up to that point.
+    void seek(uint64_t position)
+    {
+        while(tell() < position)
+        {
+            ensure(1);
+            if(cur == limit)
+            {
+                fprintf(stderr, "Error seeking trace: it is shorter than the snapshot");
+                abort();
+            }
+            cur += min<uint64_t>(limit - cur, position - tell());
+        }
+    }
+
+    // Starts reading at the micro-op of the given age (the first is 1): restarts at the
+    // nearest indexed micro-op before it and decodes forward from there.
+    void seekAge(const TraceIndex &index, uint64_t age)
+    {
+        struct stat st;
+        if(fstat(fileno(file), &st) != 0 || uint64_t(st.st_size) != index.fileSize || index.binary != binary || index.entries.empty())
+        {
+            fprintf(stderr, "Error seeking trace: the index is for another trace\n");
+            abort();
+        }
+
+        const TraceIndexEntry &e = index.find(age);
+        if(decompressor)
+        {
+            bool zstd = decompressor->zstd;
+            delete decompressor;
+            block = NULL;
+            decompressor = new TraceDecompressor;
+            decompressor->start(fileno(file), zstd, index.points[e.point], false);
+            cur = limit = &buf[0];
+            limitOffset = index.points[e.point].out;
+            inputEnd = false;
+            seek(e.offset);
+        }
+        else if(mapping)
+        {
+            cur = mapping + e.offset;
+            limit = mapping + mappingSize;
+            limitOffset = mappingSize;
+            inputEnd = false;
+        }
+        else
+        {
+            fprintf(stderr, "Error seeking trace: it is not a file\n");
+            abort();
+        }
+
+        lastPC = e.lastPC;
+        lastAddress = e.lastAddress;
+        macroTable.assign(index.macroTable.begin(), index.macroTable.begin() + e.macroCount);
+        microTable.assign(index.microTable.begin(), index.microTable.begin() + e.microCount);
+        skip(age - e.age);
+    }
+
+    // Decodes and drops count records.
+    void skip(uint64_t count)
+    {
+        TraceRecord r;
+        for(uint64_t i = 0; i < count; i++)
+            if(!next(r))
+            {
+                fprintf(stderr, "Error seeking trace: it is shorter than that\n");
+                abort();
+            }
+    }
+
+    // The decoder state needed to resume reading at tell(); restoring seeks there.
+    void serialize(Snapshot &s)
+    {
+        uint64_t position = tell();
+        bool wasBinary = binary;
+        s.io(position);
+        s.io(binary);
+        s.io(lastPC);
+        s.io(lastAddress);
+        s.io(macroTable);
+        s.io(microTable);
+        if(!s.reading)
+            return;
+        if(binary != wasBinary)
+        {
+            fprintf(stderr, "Error restoring snapshot: trace format differs");
+            abort();
+        }
+        seek(position);
+    }
+
+    // Returns false at the end of the trace.
+    bool next(TraceRecord &r)
+    {
+        return binary ? nextBinary(r) : nextText(r);
+    }
+
+    bool nextText(TraceRecord &r)
+    {
+        const char *eol;
+        while(true)
+        {
+            while(cur < limit && (*cur == '\n' || *cur == ' ' || *cur == '\t' || *cur == '\r'))
+                cur++;
+            eol = (const char*)memchr(cur, '\n', limit - cur);
+            if(eol)
+                break;
+            if(size_t(limit - cur) >= TRACE_BUFFER)
+            {
+                fprintf(stderr, "Error parsing trace");
+                abort();
+            }
+            if(inputEnd)
+            {
+                if(cur == limit)
+                    return false;
+                // unterminated last line; limit is inside the padded buf here
+                buf[limit - &buf[0]] = '\n';
+                eol = limit;
+                break;
+            }
+            ensure(limit - cur + 1);
+        }
+
+        if(!parseTextRecord(cur, r))
+        {
+            fprintf(stderr, "Error parsing trace");
+            abort();
+        }
+        cur = eol < limit ? eol + 1 : limit;
+        return true;
+    }
+
+    const uint8_t* getString(const uint8_t *p, vector<string> &table, bool isNew, const char *&s, uint8_t &len, size_t maxLen)
+    {
+        uint64_t id;
+        p = getVarint(p, id);
+        if(isNew)
+        {
+            size_t n = *p++;
+            if(id != table.size() || n > maxLen)
+            {
+                fprintf(stderr, "Error parsing trace");
+                abort();
+            }
+            table.push_back(string((const char*)p, n));
+            p += n;
+        }
+        if(id >= table.size())
+        {
+            fprintf(stderr, "Error parsing trace");
+            abort();
+        }
+        s = table[id].data();
+        len = uint8_t(table[id].size());
+        return p;
+    }
+
+    bool nextBinary(TraceRecord &r)
+    {
+        ensure(TRACE_MAX_RECORD);
+        if(cur == limit)
+            return false;
+
+        const uint8_t *p = (const uint8_t*)cur;
+        uint8_t flags = p[0];
+        r.conditionRegister = p[1];
+        r.TNnotBranch = p[2];
+        r.loadStore = p[3];
+        p += 4;
+
+        uint64_t v;
+        p = getVarint(p, v); r.microOpCount = int32_t(unzigzag(v));
+        p = getVarint(p, v); r.sourceRegister1 = int32_t(unzigzag(v));
+        p = getVarint(p, v); r.sourceRegister2 = int32_t(unzigzag(v));
+        p = getVarint(p, v); r.destinationRegister = int32_t(unzigzag(v));
+        p = getVarint(p, v); r.instructionAddress = lastPC + unzigzag(v);
+        p = getVarint(p, v); r.fallthroughPC = r.instructionAddress + unzigzag(v);
+
+        r.targetAddressTakenBranch = 0;
+        if(flags & TRACE_HAS_TARGET)
+        {
+            p = getVarint(p, v);
+            r.targetAddressTakenBranch = r.instructionAddress + unzigzag(v);
+        }
+        r.immediate = 0;
+        if(flags & TRACE_HAS_IMM)
+        {
+            p = getVarint(p, v);
+            r.immediate = unzigzag(v);
+        }
+        r.addressForMemoryOp = 0;
+        if(flags & TRACE_HAS_ADDR)
+        {
+            p = getVarint(p, v);
+            r.addressForMemoryOp = lastAddress = lastAddress + unzigzag(v);
+        }
+        p = getString(p, macroTable, flags & TRACE_NEW_MACRO, r.macroOperation, r.macroLength, 11);
+        p = getString(p, microTable, flags & TRACE_NEW_MICRO, r.microOperation, r.microLength, 22);
+        lastPC = r.instructionAddress;
+
+        cur = (const char*)p;
+        if(cur > limit)
+        {
+            fprintf(stderr, "Error parsing trace");
+            abort();
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "trace.h"
+
+// Converts a text trace on stdin to the binary trace format on stdout:
+//     zcat art-100M.trace.gz | ./traceconv > art-100M.trace.bin
+// With -d it reads a binary (or text) trace and prints it back as text. A trace file
+// may also be named as the last argument instead of being redirected.
+
+void printRecord(FILE *outputFile, const TraceRecord &r)
+{
+    fprintf(outputFile, "%" PRIi32 " %" PRIx64 " %" PRIi32 " %" PRIi32 " %" PRIi32 " %c %c %c %" PRIi64 " %" PRIx64 " %" PRIx64 " %" PRIx64 " %.*s %.*s\n",
+            r.microOpCount, r.instructionAddress, r.sourceRegister1, r.sourceRegister2, r.destinationRegister,
+            r.conditionRegister, r.TNnotBranch, r.loadStore, r.immediate, r.addressForMemoryOp,
+            r.fallthroughPC, r.targetAddressTakenBranch, r.macroLength, r.macroOperation, r.microLength, r.microOperation);
+}
+
+int main(int argc, char *argv[])
+{
+    bool decode = argc >= 2 && strcmp(argv[1], "-d") == 0;
+
+    FILE *inputFile = stdin;
+    if(argc >= 2 + decode && (inputFile = fopen(argv[1 + decode], "rb")) == NULL)
+    {
+        fprintf(stderr, "Error opening trace %s\n", argv[1 + decode]);
+        return 1;
+    }
+
+    TraceReader reader;
+    reader.open(inputFile);
+    TraceWriter writer;
+    if(!decode)
+        writer.open(stdout);
+
+    TraceRecord r;
+    uint64_t totalMicroops = 0;
+    while(reader.next(r))
+    {
+        if(decode)
+            printRecord(stdout, r);
+        else
+            writer.write(r);
+        totalMicroops++;
+    }
+
+    fprintf(stderr, "Converted %" PRIu64 " micro-ops\n", totalMicroops);
+    return 0;
+}
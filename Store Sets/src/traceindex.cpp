@@ -0,0 +1,106 @@
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "trace.h"
+
+// Builds a seek index for a trace, so the simulators can start at any micro-op
+// (--start, --parallel) without decoding everything before it:
+//     ./traceindex art-100M.trace.gz            writes art-100M.trace.gz.idx
+//     ./traceindex -k 100000 art-100M.trace.gz art.idx
+// Every k-th micro-op (default 1000000) gets an entry. In a .gz trace each entry also
+// points at a deflate block boundary before it, with the 32K window needed to resume
+// there. A .zst trace can only resume at frame boundaries, so it seeks well only if it
+// was compressed as many frames (e.g. by pzstd).
+
+int main(int argc, char *argv[])
+{
+    uint64_t interval = 1000000;
+    int arg = 1;
+    if(arg + 1 < argc && strcmp(argv[arg], "-k") == 0)
+    {
+        interval = strtoull(argv[arg + 1], NULL, 10);
+        arg += 2;
+    }
+    if(arg >= argc || interval == 0)
+    {
+        fprintf(stderr, "Usage: %s [-k uops] <trace file> [index file]\n", argv[0]);
+        return 1;
+    }
+    const char *traceName = argv[arg];
+    string indexName = arg + 1 < argc ? argv[arg + 1] : string(traceName) + ".idx";
+
+    FILE *inputFile = fopen(traceName, "rb");
+    struct stat st;
+    if(inputFile == NULL || fstat(fileno(inputFile), &st) != 0)
+    {
+        fprintf(stderr, "Error opening trace %s\n", traceName);
+        return 1;
+    }
+
+    TraceReader trace;
+    trace.open(inputFile, true);
+
+    TraceIndex index;
+    index.interval = interval;
+    index.fileSize = st.st_size;
+    index.binary = trace.binary;
+
+    TraceRecord r;
+    uint64_t age = 1;
+    while(true)
+    {
+        if((age - 1) % interval == 0)
+        {
+            TraceIndexEntry e = { age, trace.tell(), trace.lastPC, trace.lastAddress,
+                                  uint32_t(trace.macroTable.size()), uint32_t(trace.microTable.size()), 0 };
+            index.entries.push_back(e);
+        }
+        if(!trace.next(r))
+            break;
+        age++;
+    }
+    index.microops = age - 1;
+    if(index.entries.size() > 1 && index.entries.back().age > index.microops)
+        index.entries.pop_back();
+    index.macroTable = trace.macroTable;
+    index.microTable = trace.microTable;
+
+    // Keep only the restart points some entry resumes from: the last one before it.
+    if(trace.decompressor)
+    {
+        vector<TracePoint> all;
+        {
+            lock_guard<mutex> guard(trace.decompressor->lock);
+            all.swap(trace.decompressor->points);
+        }
+        size_t p = 0;
+        for(size_t i = 0; i < index.entries.size(); i++)
+        {
+            while(p + 1 < all.size() && all[p + 1].out <= index.entries[i].offset)
+                p++;
+            if(index.points.empty() || index.points.back().out != all[p].out)
+                index.points.push_back(all[p]);
+            index.entries[i].point = index.points.size() - 1;
+        }
+    }
+
+    string tmp = indexName + ".tmp";
+    FILE *file = fopen(tmp.c_str(), "wb");
+    if(file == NULL)
+    {
+        fprintf(stderr, "Error opening index %s\n", tmp.c_str());
+        return 1;
+    }
+    Snapshot s = { file, false };
+    index.serialize(s);
+    fclose(file);
+    rename(tmp.c_str(), indexName.c_str());
+
+    fprintf(stderr, "Indexed %" PRIu64 " micro-ops: %zu entries, %zu restart points\n",
+            index.microops, index.entries.size(), index.points.size());
+    return 0;
+}